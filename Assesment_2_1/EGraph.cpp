@@ -0,0 +1,792 @@
+#include "EGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace math {
+
+namespace {
+
+ENode makeNode(TokenType t, std::vector<EClassId> children)
+{
+    ENode node;
+    node._t = t;
+    node._children = std::move(children);
+    return node;
+}
+
+EClassId addBinary(EGraph &graph, TokenType t, EClassId left, EClassId right)
+{
+    return graph.add(makeNode(t, {left, right}));
+}
+
+// exact, a rewrite guarded by a constant close to v would change the value
+bool isConstant(const EGraph &graph, EClassId id, double v)
+{
+    auto c = graph.constant(id);
+    return c && *c == v;
+}
+
+bool isInteger(double v)
+{
+    return std::floor(v) == v;
+}
+
+int precedence(TokenType t)
+{
+    switch (t) {
+    case TokenType::plus:
+    case TokenType::minus:
+        return 1;
+    case TokenType::multipl:
+    case TokenType::devision:
+        return 2;
+    case TokenType::single_minus_gr:
+        return 3;
+    case TokenType::ext:
+        return 4;
+    default:
+        return 5;
+    }
+}
+
+std::shared_ptr<Operator> bracket(std::shared_ptr<Operator> op)
+{
+    return std::make_shared<UnaryOperator>(TokenType::bracket_gr, op);
+}
+
+}
+
+double CostModel::nodeCost(const EGraph &graph, const ENode &node) const
+{
+    if(_kind == Kind::nodeCount)
+        return 1.;
+
+    switch (node._t) {
+    case TokenType::plus:
+    case TokenType::minus:
+    case TokenType::multipl:
+    case TokenType::single_minus_gr:
+        return 1.;
+    case TokenType::devision:
+        return 4.;
+    case TokenType::exp:
+    case TokenType::function:
+        return 20.;
+    case TokenType::ext:
+    {
+        auto power = graph.constant(node._children[1]);
+        if(power && *power > 0 && *power <= 16 && std::round(*power) == *power)
+            return std::ceil(std::log2(*power)) + 1.;
+
+        return 40.;
+    }
+    default:
+        return 0.;
+    }
+}
+
+EClassId EGraph::find(EClassId id) const
+{
+    while(_parents[id] != id)
+    {
+        _parents[id] = _parents[_parents[id]];
+        id = _parents[id];
+    }
+
+    return id;
+}
+
+ENode EGraph::canonicalize(ENode node) const
+{
+    for(auto &child : node._children)
+        child = find(child);
+
+    return node;
+}
+
+std::optional<double> EGraph::fold(const ENode &node) const
+{
+    if(node._t == TokenType::value)
+        return node._v;
+
+    if(node.isVariable())
+        return std::nullopt;
+
+    std::vector<double> values;
+    for(auto child : node._children)
+    {
+        auto c = _classes[find(child)]._constant;
+        if(!c)
+            return std::nullopt;
+
+        values.push_back(*c);
+    }
+
+    double res = 0.;
+
+    switch (node._t) {
+    case TokenType::exp:
+        res = exp(values[0]);
+        break;
+    case TokenType::function:
+        res = node._intrinsic->_scalar(values[0]);
+        break;
+    case TokenType::single_minus_gr:
+        res = -values[0];
+        break;
+    case TokenType::plus:
+        res = values[0] + values[1];
+        break;
+    case TokenType::minus:
+        res = values[0] - values[1];
+        break;
+    case TokenType::multipl:
+        res = values[0] * values[1];
+        break;
+    case TokenType::devision:
+        if(values[1] == 0.)
+            return std::nullopt;
+        res = values[0] / values[1];
+        break;
+    case TokenType::ext:
+        res = pow(values[0], values[1]);
+        break;
+    default:
+        return std::nullopt;
+    }
+
+    if(!std::isfinite(res))
+        return std::nullopt;
+
+    return res;
+}
+
+EClassId EGraph::add(ENode node)
+{
+    node = canonicalize(std::move(node));
+
+    auto it = _memo.find(node);
+    if(it != _memo.end())
+        return find(it->second);
+
+    const EClassId id = _classes.size();
+    _parents.push_back(id);
+
+    EClass eclass;
+    eclass._constant = fold(node);
+    eclass._nodes.push_back(node);
+    _classes.emplace_back(std::move(eclass));
+
+    _memo.emplace(std::move(node), id);
+
+    if(_classes[id]._constant && _classes[id]._nodes[0]._t != TokenType::value)
+        merge(id, addConstant(*_classes[id]._constant));
+
+    return find(id);
+}
+
+EClassId EGraph::addConstant(double v)
+{
+    ENode node;
+    node._v = v;
+    return add(node);
+}
+
+EClassId EGraph::addOperator(const Operator *op)
+{
+    if(!op)
+        throw std::runtime_error("Empty operator can't be added to e-graph");
+
+    auto it = _converted.find(op);
+    if(it != _converted.end())
+        return find(it->second);
+
+    EClassId res = 0;
+
+    if(auto constantOp = op->to<ConstantOperator>())
+    {
+        res = addConstant(constantOp->_v);
+    }
+    else if(auto variableOp = op->to<VariableOperator>())
+    {
+        ENode node;
+        node._t = variableOp->_t;
+        node._deep = variableOp->_deep;
+        res = add(node);
+    }
+    else if(auto unaryOp = op->to<UnaryOperator>())
+    {
+        auto sub = addOperator(unaryOp->_sub_group.get());
+
+        switch (unaryOp->_t) {
+        case TokenType::bracket_gr:
+            res = sub;
+            break;
+        case TokenType::exp:
+        case TokenType::exp_gr:
+            res = add(makeNode(TokenType::exp, {sub}));
+            break;
+        case TokenType::minus:
+            res = add(makeNode(TokenType::single_minus_gr, {sub}));
+            break;
+        default:
+            throw std::runtime_error("Unsupported unary operator for e-graph");
+        }
+    }
+    else if(auto binaryOp = op->to<BinaryOperator>())
+    {
+        res = addBinary(*this, binaryOp->_t, addOperator(binaryOp->_left.get()), addOperator(binaryOp->_right.get()));
+    }
+    else if(auto functionOp = op->to<FunctionOperator>())
+    {
+        auto node = makeNode(TokenType::function, {addOperator(functionOp->_sub_group.get())});
+        node._intrinsic = functionOp->_intrinsic;
+        res = add(node);
+    }
+    else if(auto functional = op->to<Functional>())
+    {
+        res = addOperator(functional->_sintaxis_tree_root.get());
+    }
+    else if(auto derivativeOf = op->to<DerivativeOf>())
+    {
+        auto expansion = derivativeOf->expansion();
+        res = expansion ? addOperator(expansion.get()) : addConstant(0.);
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported operator for e-graph");
+    }
+
+    _converted[op] = res;
+    return res;
+}
+
+bool EGraph::merge(EClassId a, EClassId b)
+{
+    a = find(a);
+    b = find(b);
+
+    if(a == b)
+        return false;
+
+    if(_classes[a]._nodes.size() < _classes[b]._nodes.size())
+        std::swap(a, b);
+
+    auto &to = _classes[a];
+    auto &from = _classes[b];
+
+    to._nodes.insert(to._nodes.end(), from._nodes.begin(), from._nodes.end());
+    if(!to._constant)
+        to._constant = from._constant;
+
+    from._nodes.clear();
+    from._nodes.shrink_to_fit();
+
+    _parents[b] = a;
+    _dirty = true;
+    return true;
+}
+
+void EGraph::rebuild()
+{
+    bool changed = true;
+
+    while(changed)
+    {
+        changed = false;
+        _memo.clear();
+
+        std::vector<std::pair<EClassId, EClassId>> congruent;
+
+        for(auto id = 0u; id < _classes.size(); id++)
+        {
+            if(find(id) != id)
+                continue;
+
+            auto &nodes = _classes[id]._nodes;
+            for(auto &node : nodes)
+                node = canonicalize(std::move(node));
+
+            std::vector<ENode> unique;
+            for(auto &node : nodes)
+            {
+                auto [it, inserted] = _memo.emplace(node, id);
+                if(inserted)
+                    unique.push_back(node);
+                else if(find(it->second) != id)
+                    congruent.emplace_back(it->second, id);
+            }
+
+            nodes = std::move(unique);
+        }
+
+        for(auto [a, b] : congruent)
+            changed |= merge(a, b);
+
+        if(changed)
+            continue;
+
+        std::vector<EClassId> folded;
+
+        for(auto id = 0u; id < _classes.size(); id++)
+        {
+            if(find(id) != id)
+                continue;
+
+            auto &eclass = _classes[id];
+
+            for(auto i = 0u; !eclass._constant && i < eclass._nodes.size(); i++)
+                eclass._constant = fold(eclass._nodes[i]);
+
+            if(!eclass._constant)
+                continue;
+
+            auto hasValue = std::any_of(eclass._nodes.begin(), eclass._nodes.end(),
+                                        [](const ENode &node){ return node._t == TokenType::value; });
+            if(!hasValue)
+                folded.push_back(id);
+        }
+
+        for(auto id : folded)
+        {
+            merge(id, addConstant(*_classes[find(id)]._constant));
+            changed = true;
+        }
+    }
+
+    _dirty = false;
+}
+
+size_t EGraph::classesCount() const
+{
+    size_t res = 0;
+    for(auto id = 0u; id < _classes.size(); id++)
+        if(find(id) == id)
+            res++;
+
+    return res;
+}
+
+size_t EGraph::saturate(const std::vector<Rule> &rules, const EGraphLimits &limits)
+{
+    if(_dirty)
+        rebuild();
+
+    size_t iteration = 0;
+
+    for(; iteration < limits._maxIterations; iteration++)
+    {
+        std::vector<Match> matches;
+
+        for(auto id = 0u; id < _classes.size(); id++)
+        {
+            if(find(id) != id)
+                continue;
+
+            const auto nodes = _classes[id]._nodes;
+            for(const auto &node : nodes)
+                for(const auto &rule : rules)
+                    rule._search(*this, id, node, matches);
+        }
+
+        const auto nodesBefore = nodesCount();
+        const auto classesBefore = classesCount();
+
+        for(auto &match : matches)
+        {
+            match(*this);
+
+            if(_memo.size() > limits._maxNodes)
+                break;
+        }
+
+        rebuild();
+
+        if(nodesCount() > limits._maxNodes)
+            break;
+
+        if(nodesCount() == nodesBefore && classesCount() == classesBefore)
+            break;
+    }
+
+    return iteration;
+}
+
+std::shared_ptr<Operator> EGraph::extract(EClassId root, const CostModel &cost) const
+{
+    const auto inf = std::numeric_limits<double>::infinity();
+
+    std::vector<double> bestCost(_classes.size(), inf);
+    std::vector<const ENode*> bestNode(_classes.size(), nullptr);
+
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+
+        for(auto id = 0u; id < _classes.size(); id++)
+        {
+            if(find(id) != id)
+                continue;
+
+            for(const auto &node : _classes[id]._nodes)
+            {
+                auto nodeCost = cost.nodeCost(*this, node);
+                for(auto child : node._children)
+                    nodeCost += bestCost[find(child)];
+
+                if(nodeCost < bestCost[id])
+                {
+                    bestCost[id] = nodeCost;
+                    bestNode[id] = &node;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::function<std::shared_ptr<Operator>(EClassId)> build = [&](EClassId id) -> std::shared_ptr<Operator> {
+        const auto *node = bestNode[find(id)];
+        if(!node)
+            throw std::runtime_error("E-graph class has no finite representation");
+
+        if(node->_t == TokenType::value)
+        {
+            auto res = constantOperator(node->_v);
+            if(node->_v < 0)
+                return bracket(res);
+
+            return res;
+        }
+
+        if(node->isVariable())
+            return std::make_shared<VariableOperator>(node->_t, node->_deep);
+
+        if(node->_t == TokenType::exp)
+            return std::make_shared<UnaryOperator>(TokenType::exp, bracket(build(node->_children[0])));
+
+        if(node->_t == TokenType::function)
+            return std::make_shared<FunctionOperator>(node->_intrinsic, bracket(build(node->_children[0])));
+
+        if(node->_t == TokenType::single_minus_gr)
+            return std::make_shared<UnaryOperator>(TokenType::minus, build(node->_children[0]));
+
+        auto left = build(node->_children[0]);
+        auto right = build(node->_children[1]);
+
+        const auto p = precedence(node->_t);
+        const auto lp = precedence(bestNode[find(node->_children[0])]->_t);
+        const auto rp = precedence(bestNode[find(node->_children[1])]->_t);
+
+        const bool rightIsStrict = node->_t == TokenType::minus || node->_t == TokenType::devision || node->_t == TokenType::ext;
+
+        if(lp < p || (node->_t == TokenType::ext && lp <= p))
+            left = bracket(left);
+        if(rp < p || (rightIsStrict && rp <= p))
+            right = bracket(right);
+
+        return std::make_shared<BinaryOperator>(node->_t, left, right);
+    };
+
+    return build(root);
+}
+
+const std::vector<EGraph::Rule> &EGraph::defaultRules()
+{
+    using Matches = std::vector<Match>;
+
+    static const std::vector<Rule> s_Rules = {
+        { "commutativity", [](const EGraph &, EClassId id, const ENode &node, Matches &matches){
+              if(node._t != TokenType::plus && node._t != TokenType::multipl)
+                  return;
+
+              auto t = node._t;
+              auto l = node._children[0];
+              auto r = node._children[1];
+              matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, t, r, l)); });
+          }},
+        { "associativity", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._t != TokenType::plus && node._t != TokenType::multipl)
+                  return;
+
+              auto t = node._t;
+              auto c = node._children[1];
+              for(const auto &left : graph.eclass(node._children[0])._nodes)
+              {
+                  if(left._t != t)
+                      continue;
+
+                  auto a = left._children[0];
+                  auto b = left._children[1];
+                  matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, t, a, addBinary(g, t, b, c))); });
+              }
+          }},
+        { "distributivity", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._t != TokenType::multipl)
+                  return;
+
+              auto a = node._children[0];
+              for(const auto &right : graph.eclass(node._children[1])._nodes)
+              {
+                  if(right._t != TokenType::plus && right._t != TokenType::minus)
+                      continue;
+
+                  auto t = right._t;
+                  auto b = right._children[0];
+                  auto c = right._children[1];
+                  matches.push_back([=](EGraph &g){
+                      g.merge(id, addBinary(g, t, addBinary(g, TokenType::multipl, a, b), addBinary(g, TokenType::multipl, a, c)));
+                  });
+              }
+          }},
+        { "common factor", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._t != TokenType::plus && node._t != TokenType::minus)
+                  return;
+
+              auto t = node._t;
+              auto l = graph.find(node._children[0]);
+              auto r = graph.find(node._children[1]);
+
+              for(const auto &left : graph.eclass(l)._nodes)
+              {
+                  if(left._t != TokenType::multipl)
+                      continue;
+
+                  auto a = graph.find(left._children[0]);
+                  auto b = left._children[1];
+
+                  // a*b +- a  ->  a*(b +- 1)
+                  if(a == r)
+                      matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::multipl, a, addBinary(g, t, b, g.addConstant(1.)))); });
+
+                  for(const auto &right : graph.eclass(r)._nodes)
+                  {
+                      if(right._t != TokenType::multipl || graph.find(right._children[0]) != a)
+                          continue;
+
+                      auto c = right._children[1];
+                      matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::multipl, a, addBinary(g, t, b, c))); });
+                  }
+              }
+
+              // a +- a*c  ->  a*(1 +- c)
+              for(const auto &right : graph.eclass(r)._nodes)
+              {
+                  if(right._t != TokenType::multipl || graph.find(right._children[0]) != l)
+                      continue;
+
+                  auto c = right._children[1];
+                  matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::multipl, l, addBinary(g, t, g.addConstant(1.), c))); });
+              }
+
+              // a/c +- b/c  ->  (a +- b)/c
+              for(const auto &left : graph.eclass(l)._nodes)
+              {
+                  if(left._t != TokenType::devision)
+                      continue;
+
+                  for(const auto &right : graph.eclass(r)._nodes)
+                  {
+                      if(right._t != TokenType::devision || graph.find(right._children[1]) != graph.find(left._children[1]))
+                          continue;
+
+                      auto a = left._children[0];
+                      auto b = right._children[0];
+                      auto c = left._children[1];
+                      matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::devision, addBinary(g, t, a, b), c)); });
+                  }
+              }
+          }},
+        { "exp identities", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._t != TokenType::multipl && node._t != TokenType::devision)
+                  return;
+
+              // exp(a)*exp(b) -> exp(a+b), exp(a)/exp(b) -> exp(a-b)
+              auto t = node._t == TokenType::multipl ? TokenType::plus : TokenType::minus;
+              for(const auto &left : graph.eclass(node._children[0])._nodes)
+              {
+                  if(left._t != TokenType::exp)
+                      continue;
+
+                  for(const auto &right : graph.eclass(node._children[1])._nodes)
+                  {
+                      if(right._t != TokenType::exp)
+                          continue;
+
+                      auto a = left._children[0];
+                      auto b = right._children[0];
+                      matches.push_back([=](EGraph &g){ g.merge(id, g.add(makeNode(TokenType::exp, {addBinary(g, t, a, b)}))); });
+                  }
+              }
+          }},
+        { "pow identities", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._children.size() != 2)
+                  return;
+
+              auto l = graph.find(node._children[0]);
+              auto r = graph.find(node._children[1]);
+
+              if(node._t == TokenType::ext)
+              {
+                  if(isConstant(graph, r, 1.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, l); });
+                  if(isConstant(graph, r, 0.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, g.addConstant(1.)); });
+
+                  // (a^m)^n -> a^(m*n) for integer m and n only: (x^2)^0.5 is |x|, not x,
+                  // and (x^0.5)^2 is NaN for a negative x, not x
+                  for(const auto &left : graph.eclass(l)._nodes)
+                  {
+                      if(left._t != TokenType::ext)
+                          continue;
+
+                      auto m = graph.constant(left._children[1]);
+                      auto n = graph.constant(r);
+                      if(!m || !n || !isInteger(*m) || !isInteger(*n))
+                          continue;
+
+                      auto a = left._children[0];
+                      auto power = *m * *n;
+                      matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::ext, a, g.addConstant(power))); });
+                  }
+                  return;
+              }
+
+              if(node._t != TokenType::multipl && node._t != TokenType::devision)
+                  return;
+
+              const bool isMultipl = node._t == TokenType::multipl;
+
+              // a*a -> a^2
+              if(isMultipl && l == r)
+                  matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::ext, l, g.addConstant(2.))); });
+
+              auto powers = [&graph](EClassId cl, std::vector<std::pair<EClassId, double>> &res){
+                  res.emplace_back(cl, 1.);
+                  for(const auto &n : graph.eclass(cl)._nodes)
+                  {
+                      if(n._t != TokenType::ext)
+                          continue;
+
+                      if(auto power = graph.constant(n._children[1]))
+                          res.emplace_back(graph.find(n._children[0]), *power);
+                  }
+              };
+
+              std::vector<std::pair<EClassId, double>> leftPowers;
+              std::vector<std::pair<EClassId, double>> rightPowers;
+              powers(l, leftPowers);
+              powers(r, rightPowers);
+
+              // a^m*a^n -> a^(m+n), a^m/a^n -> a^(m-n)
+              for(auto [a, m] : leftPowers)
+              {
+                  for(auto [b, n] : rightPowers)
+                  {
+                      if(a != b || (m == 1. && n == 1.))
+                          continue;
+
+                      // a fractional power is NaN for a negative base, so an integer one may only come of integers:
+                      // x^0.5*x^0.5 is not x there
+                      auto power = isMultipl ? m + n : m - n;
+                      if(isInteger(power) && (!isInteger(m) || !isInteger(n)))
+                          continue;
+
+                      auto base = a;
+                      if(power < 0)
+                          matches.push_back([=](EGraph &g){
+                              g.merge(id, addBinary(g, TokenType::devision, g.addConstant(1.), addBinary(g, TokenType::ext, base, g.addConstant(-power))));
+                          });
+                      else
+                          matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, TokenType::ext, base, g.addConstant(power))); });
+                  }
+              }
+          }},
+        { "identities", [](const EGraph &graph, EClassId id, const ENode &node, Matches &matches){
+              if(node._children.empty())
+                  return;
+
+              auto l = graph.find(node._children[0]);
+
+              if(node._t == TokenType::single_minus_gr)
+              {
+                  for(const auto &sub : graph.eclass(l)._nodes)
+                      if(sub._t == TokenType::single_minus_gr)
+                      {
+                          auto a = sub._children[0];
+                          matches.push_back([=](EGraph &g){ g.merge(id, a); });
+                      }
+                  return;
+              }
+
+              if(node._children.size() < 2)
+                  return;
+
+              auto r = graph.find(node._children[1]);
+
+              switch (node._t) {
+              case TokenType::multipl:
+                  if(isConstant(graph, r, 1.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, l); });
+                  if(isConstant(graph, r, 0.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, g.addConstant(0.)); });
+                  if(isConstant(graph, r, -1.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, g.add(makeNode(TokenType::single_minus_gr, {l}))); });
+
+                  // (-a)*b -> -(a*b)
+                  for(const auto &left : graph.eclass(l)._nodes)
+                      if(left._t == TokenType::single_minus_gr)
+                      {
+                          auto a = left._children[0];
+                          matches.push_back([=](EGraph &g){
+                              g.merge(id, g.add(makeNode(TokenType::single_minus_gr, {addBinary(g, TokenType::multipl, a, r)})));
+                          });
+                      }
+                  break;
+              case TokenType::devision:
+                  if(isConstant(graph, r, 1.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, l); });
+                  break;
+              case TokenType::plus:
+              case TokenType::minus:
+              {
+                  if(isConstant(graph, r, 0.))
+                      matches.push_back([=](EGraph &g){ g.merge(id, l); });
+                  if(node._t == TokenType::minus && l == r)
+                      matches.push_back([=](EGraph &g){ g.merge(id, g.addConstant(0.)); });
+
+                  // a - (-b) -> a + b, a + (-b) -> a - b
+                  auto t = node._t == TokenType::plus ? TokenType::minus : TokenType::plus;
+                  for(const auto &right : graph.eclass(r)._nodes)
+                      if(right._t == TokenType::single_minus_gr)
+                      {
+                          auto b = right._children[0];
+                          matches.push_back([=](EGraph &g){ g.merge(id, addBinary(g, t, l, b)); });
+                      }
+                  break;
+              }
+              default:
+                  break;
+              }
+          }},
+    };
+
+    return s_Rules;
+}
+
+std::shared_ptr<Operator> optimize(std::shared_ptr<Operator> op, const CostModel &cost, const EGraphLimits &limits)
+{
+    if(!op)
+        return nullptr;
+
+    EGraph graph;
+    auto root = graph.addOperator(op.get());
+    graph.rebuild();
+    graph.saturate(EGraph::defaultRules(), limits);
+
+    return graph.extract(root, cost);
+}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <optional>
+
+#include "Equation.h"
+
+namespace math {
+
+using EClassId = size_t;
+
+// one operation over equivalence classes:
+// value - constant, var_* - variable, exp / single_minus_gr / function - unary, plus, minus, multipl, devision, ext - binary
+struct ENode {
+    TokenType _t = TokenType::value;
+    double _v = 0.;
+    int _deep = 0;
+    const Intrinsic *_intrinsic = nullptr;
+    std::vector<EClassId> _children;
+
+    bool isVariable() const
+    {
+        return _t == TokenType::var_xi || _t == TokenType::var_mi || _t == TokenType::var_di || _t == TokenType::phi_i_1;
+    }
+
+    bool operator==(const ENode &other) const
+    {
+        return _t == other._t && _v == other._v && _deep == other._deep && _intrinsic == other._intrinsic
+               && _children == other._children;
+    }
+};
+
+struct ENodeHash {
+    size_t operator()(const ENode &node) const
+    {
+        size_t h = std::hash<int>()(static_cast<int>(node._t));
+        auto combine = [&h](size_t v){ h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2); };
+
+        combine(std::hash<double>()(node._v));
+        combine(std::hash<int>()(node._deep));
+        combine(std::hash<const Intrinsic*>()(node._intrinsic));
+        for(auto child : node._children)
+            combine(child);
+
+        return h;
+    }
+};
+
+struct EClass {
+    std::vector<ENode> _nodes;
+    std::optional<double> _constant;
+};
+
+class EGraph;
+
+class CostModel {
+public:
+    enum class Kind : int {
+        nodeCount = 0,
+        flops
+    };
+
+    CostModel(Kind kind = Kind::nodeCount) : _kind(kind) {}
+
+    double nodeCost(const EGraph &graph, const ENode &node) const;
+
+    Kind _kind;
+};
+
+struct EGraphLimits {
+    size_t _maxNodes = 20000;
+    size_t _maxIterations = 8;
+};
+
+class EGraph {
+public:
+    using Match = std::function<void(EGraph &)>;
+
+    struct Rule {
+        std::string _name;
+        std::function<void(const EGraph &, EClassId, const ENode &, std::vector<Match> &)> _search;
+    };
+
+    EClassId find(EClassId id) const;
+    EClassId add(ENode node);
+    EClassId addConstant(double v);
+    EClassId addOperator(const Operator *op);
+    bool merge(EClassId a, EClassId b);
+    void rebuild();
+
+    // runs rules until saturation or limits; returns number of performed iterations
+    size_t saturate(const std::vector<Rule> &rules, const EGraphLimits &limits);
+
+    std::shared_ptr<Operator> extract(EClassId root, const CostModel &cost) const;
+
+    const EClass &eclass(EClassId id) const { return _classes[find(id)]; }
+    std::optional<double> constant(EClassId id) const { return eclass(id)._constant; }
+
+    size_t nodesCount() const { return _memo.size(); }
+    size_t classesCount() const;
+
+    static const std::vector<Rule> &defaultRules();
+
+private:
+    ENode canonicalize(ENode node) const;
+    std::optional<double> fold(const ENode &node) const;
+
+    mutable std::vector<EClassId> _parents;
+    std::vector<EClass> _classes;
+    std::unordered_map<ENode, EClassId, ENodeHash> _memo;
+    std::unordered_map<const Operator*, EClassId> _converted;
+    bool _dirty = false;
+};
+
+// returns the minimum-cost equivalent of the expression found by equality saturation
+std::shared_ptr<Operator> optimize(std::shared_ptr<Operator> op,
+                                   const CostModel &cost = CostModel(),
+                                   const EGraphLimits &limits = EGraphLimits());
+
+}
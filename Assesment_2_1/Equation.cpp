@@ -2,12 +2,106 @@
 
 namespace math {
 
-std::shared_ptr<Operator> UnaryOperator::derevative(TokenType t, int deep) const
+SubDerevative eagerSubDerevative(TokenType t, int deep)
 {
-    if(!_sub_group->isParametrique(t, deep))
+    return [t, deep](const OperatorPtr &sub) -> OperatorPtr {
+        return sub->isParametrique(t, deep) ? sub->derevative(t, deep) : nullptr;
+    };
+}
+
+SubDerevative lazySubDerevative(TokenType t, int deep)
+{
+    return [t, deep](const OperatorPtr &sub) -> OperatorPtr {
+        if(!sub->isParametrique(t, deep))
+            return nullptr;
+
+        // leaves are cheaper to derive than to wrap
+        if(sub->to<VariableOperator>() || sub->to<ConstantOperator>())
+            return sub->derevative(t, deep);
+
+        return std::make_shared<DerivativeOf>(sub, t, deep);
+    };
+}
+
+DerivativeOf::DerivativeOf(std::shared_ptr<Operator> node, TokenType t, int deep)
+    : _node(node), _t(t), _deep(deep)
+{
+    if(!_node)
+        throw std::runtime_error("Derevative of empty operator");
+
+    while(auto functional = _node->to<Functional>())
+        _node = functional->_sintaxis_tree_root;
+}
+
+std::shared_ptr<Operator> DerivativeOf::expansion() const
+{
+    if(_expanded)
+        return _expansion;
+
+    const auto sub = lazySubDerevative(_t, _deep);
+
+    if(auto unaryOp = _node->to<UnaryOperator>())
+        _expansion = unaryOp->derevative(sub);
+    else if(auto binaryOp = _node->to<BinaryOperator>())
+        _expansion = binaryOp->derevative(sub);
+    else if(auto functionOp = _node->to<FunctionOperator>())
+        _expansion = functionOp->derevative(sub);
+    else if(_node->isParametrique(_t, _deep))
+        _expansion = _node->derevative(_t, _deep);
+
+    // pass-through levels like brackets give another lazy node, collapse it
+    if(_expansion)
+    {
+        if(auto next = _expansion->to<DerivativeOf>())
+            _expansion = next->expansion();
+    }
+
+    _expanded = true;
+    return _expansion;
+}
+
+std::shared_ptr<Operator> lazyDerevative(std::shared_ptr<Operator> op, TokenType t, int deep)
+{
+    if(!op || !op->isParametrique(t, deep))
         return nullptr;
 
-    auto unaryDerevative = _sub_group->derevative(t, deep);
+    return lazySubDerevative(t, deep)(op);
+}
+
+std::vector<std::shared_ptr<Operator>> subOperators(const Operator *op)
+{
+    if(auto unaryOp = op->to<UnaryOperator>())
+        return { unaryOp->_sub_group };
+    if(auto binaryOp = op->to<BinaryOperator>())
+        return { binaryOp->_left, binaryOp->_right };
+    if(auto functional = op->to<Functional>())
+        return { functional->_sintaxis_tree_root };
+    if(auto functionOp = op->to<FunctionOperator>())
+        return { functionOp->_sub_group };
+    if(auto derivativeOf = op->to<DerivativeOf>())
+    {
+        if(auto expansion = derivativeOf->expansion())
+            return { expansion };
+    }
+
+    return {};
+}
+
+std::shared_ptr<Operator> constantOperator(double v)
+{
+    if(v == 1.)
+        return std::make_shared<OneValueOperator>();
+    if(v == 2.)
+        return std::make_shared<SquareOperator>();
+
+    return std::make_shared<ConstantOperator>(v);
+}
+
+std::shared_ptr<Operator> UnaryOperator::derevative(const SubDerevative &sub) const
+{
+    auto unaryDerevative = sub(_sub_group);
+    if(!unaryDerevative)
+        return nullptr;
 
     switch (_t) {
     case TokenType::bracket_gr:
@@ -33,7 +127,11 @@ std::string UnaryOperator::toString() const
     {
     case TokenType::minus:
     {
-        if(auto sub =_sub_group->to<BinaryOperator>())
+        auto subGroup = _sub_group;
+        if(auto derivativeOf = subGroup->to<DerivativeOf>())
+            subGroup = derivativeOf->expansion();
+
+        if(auto sub = subGroup ? subGroup->to<BinaryOperator>() : nullptr)
         {
             if(sub->_t != TokenType::ext)
                 return g_LiteralTokens.at(_t) + "(" + _sub_group->toString() + ")";
@@ -55,18 +153,16 @@ std::shared_ptr<Operator> Equation::tokenToOperator(std::shared_ptr<Token> token
         return std::make_shared<VariableOperator>(token->_type);
 
     if(token->_type == TokenType::phi_i_1)
-        return std::make_shared<Functional>(_phi_i_1);
-
-    if(auto tokenV = std::dynamic_pointer_cast<TokenValue>(token))
     {
-        if(tokenV->_v == 1.)
-            return std::make_shared<OneValueOperator>();
-        if(tokenV->_v == 2.)
-            return std::make_shared<SquareOperator>();
+        if(!_phi_i_1)
+            return std::make_shared<VariableOperator>(token->_type);
 
-        return std::make_shared<ConstantOperator>(tokenV->_v);
+        return std::make_shared<Functional>(_phi_i_1);
     }
 
+    if(auto tokenV = std::dynamic_pointer_cast<TokenValue>(token))
+        return constantOperator(tokenV->_v);
+
     if(auto tokenG = std::dynamic_pointer_cast<TokenGroup>(token))
     {
         if(tokenG->_group.empty())
@@ -77,6 +173,14 @@ std::shared_ptr<Operator> Equation::tokenToOperator(std::shared_ptr<Token> token
             return std::make_shared<UnaryOperator>(tokenG->_type, tokenToOperator(*tokenG->_group.begin()));
         case TokenType::exp_gr:
             return std::make_shared<UnaryOperator>((*tokenG->_group.begin())->_type, tokenToOperator(*tokenG->_group.rbegin()));
+        case TokenType::function_gr:
+        {
+            auto tokenF = std::dynamic_pointer_cast<TokenFunction>(*tokenG->_group.begin());
+            if(!tokenF)
+                throw std::runtime_error("Parser error.");
+
+            return std::make_shared<FunctionOperator>(tokenF->_intrinsic, tokenToOperator(*tokenG->_group.rbegin()));
+        }
         case TokenType::single_minus_gr:
             return std::make_shared<UnaryOperator>(TokenType::minus, tokenToOperator(*tokenG->_group.rbegin()));
         case TokenType::ext_gr:
@@ -7,8 +7,12 @@
 #include <list>
 #include <stack>
 #include <deque>
+#include <map>
+#include <vector>
 #include <math.h>
 
+#include "Intrinsics.h"
+
 namespace math {
 
 enum class TokenType : int {
@@ -36,6 +40,8 @@ enum class TokenType : int {
     single_minus_gr,
     nothing,
     phi_i_1,
+    function,
+    function_gr,
 };
 
 const static std::unordered_map<std::string, TokenType> g_TokenLiterals = {
@@ -69,9 +75,31 @@ public:
 
     virtual ~CalculationContext() = default;
 
+    virtual double value(TokenType, int) const { return _parameterV; }
+
     double _parameterV = 0;
 };
 
+// keeps own value for every bound variable, unbound variables get the parameter value
+class VariablesContext : public CalculationContext {
+public:
+    VariablesContext(double parameterV = 0)
+        : CalculationContext(parameterV) {}
+
+    void set(TokenType t, int deep, double v)
+    {
+        _values[{t, deep}] = v;
+    }
+
+    virtual double value(TokenType t, int deep) const
+    {
+        auto it = _values.find({t, deep});
+        return it != _values.end() ? it->second : _parameterV;
+    }
+
+    std::map<std::pair<TokenType, int>, double> _values;
+};
+
 class Operator {
 public:
     virtual ~Operator() = default;
@@ -93,6 +121,12 @@ public:
 
 using OperatorPtr = std::shared_ptr<Operator>;
 
+// derevative of a sub operator, nullptr when it doesn't depend on the parameter
+using SubDerevative = std::function<OperatorPtr(const OperatorPtr &sub)>;
+
+SubDerevative eagerSubDerevative(TokenType t, int deep);
+SubDerevative lazySubDerevative(TokenType t, int deep);
+
 OperatorPtr operator+(OperatorPtr left, OperatorPtr right);
 OperatorPtr operator-(OperatorPtr left, OperatorPtr right);
 OperatorPtr operator*(OperatorPtr left, OperatorPtr right);
@@ -178,7 +212,7 @@ public:
 
     virtual double produce(const CalculationContext &context) const
     {
-        return context._parameterV;
+        return context.value(_t, _deep);
     }
 
     virtual std::string toString() const
@@ -222,6 +256,7 @@ public:
             case TokenType::bracket_gr:
                 _action = [](double v){ return v; };
                 break;
+            case TokenType::exp:
             case TokenType::exp_gr:
                 _action = [](double v){ return exp(v); };
                 break;
@@ -248,7 +283,12 @@ public:
         return std::make_shared<UnaryOperator>(_t, _sub_group->clone());
     }
 
-    virtual std::shared_ptr<Operator> derevative(TokenType t, int deep) const;
+    virtual std::shared_ptr<Operator> derevative(TokenType t, int deep) const
+    {
+        return derevative(eagerSubDerevative(t, deep));
+    }
+
+    std::shared_ptr<Operator> derevative(const SubDerevative &sub) const;
 
     virtual void addDeep() { _sub_group->addDeep(); }
 
@@ -319,8 +359,13 @@ public:
 
     virtual std::shared_ptr<Operator> derevative(TokenType t, int deep) const
     {
-        std::shared_ptr<Operator> l = _left->isParametrique(t, deep) ? _left->derevative(t, deep) : nullptr;
-        std::shared_ptr<Operator> r = _right->isParametrique(t, deep) ? _right->derevative(t, deep) : nullptr;
+        return derevative(eagerSubDerevative(t, deep));
+    }
+
+    std::shared_ptr<Operator> derevative(const SubDerevative &sub) const
+    {
+        std::shared_ptr<Operator> l = sub(_left);
+        std::shared_ptr<Operator> r = sub(_right);
 
         switch(_t)
         {
@@ -354,7 +399,7 @@ public:
                         auto two_ab = std::make_shared<SquareOperator>() * llc * rrc;
 
                         auto fsumm = subGr->_t == TokenType::plus ? llc_sqare + two_ab : llc_sqare - two_ab;
-                        return (fsumm + rrc_sqare)->derevative(t, deep);
+                        return sub(fsumm + rrc_sqare);
                     }
                 }
             }
@@ -436,6 +481,57 @@ public:
     std::function<double(double lV, double rV)> _action;
 };
 
+class FunctionOperator : public Operator {
+public:
+
+    FunctionOperator(const Intrinsic *intrinsic,
+                     std::shared_ptr<Operator> sub_group)
+        : _intrinsic(intrinsic), _sub_group(sub_group) {}
+
+    virtual double produce(const CalculationContext &context) const
+    {
+        return _intrinsic->_scalar(_sub_group->produce(context));
+    }
+
+    virtual std::string toString() const
+    {
+        auto bracket = _sub_group->to<UnaryOperator>();
+        if(bracket && bracket->_t == TokenType::bracket_gr)
+            return _intrinsic->_name + _sub_group->toString();
+
+        return _intrinsic->_name + "(" + _sub_group->toString() + ")";
+    }
+
+    virtual bool isParametrique(TokenType paramT, int deep) const
+    {
+        return _sub_group->isParametrique(paramT, deep);
+    }
+
+    virtual std::shared_ptr<Operator> clone() const
+    {
+        return std::make_shared<FunctionOperator>(_intrinsic, _sub_group->clone());
+    }
+
+    virtual std::shared_ptr<Operator> derevative(TokenType t, int deep) const
+    {
+        return derevative(eagerSubDerevative(t, deep));
+    }
+
+    std::shared_ptr<Operator> derevative(const SubDerevative &sub) const
+    {
+        auto subDerevative = sub(_sub_group);
+        if(!subDerevative)
+            return nullptr;
+
+        return _intrinsic->_derevative(_sub_group->clone()) * subDerevative;
+    }
+
+    virtual void addDeep() { _sub_group->addDeep(); }
+
+    const Intrinsic *_intrinsic;
+    std::shared_ptr<Operator> _sub_group;
+};
+
 class Functional : public Operator{
 public:
 
@@ -472,12 +568,85 @@ public:
     std::shared_ptr<Operator> _sintaxis_tree_root;
 };
 
+// lazy counterpart of op->derevative(t, deep)
+std::shared_ptr<Operator> lazyDerevative(std::shared_ptr<Operator> op, TokenType t, int deep = 0);
+
+// stands for d(node)/dt(deep) without building it: the derevative is expanded one level
+// on first use and sub derevatives stay lazy until something reads them.
+// The node is shared, not cloned, so it should not be modified while the derevative is alive.
+class DerivativeOf : public Operator {
+public:
+
+    DerivativeOf(std::shared_ptr<Operator> node, TokenType t, int deep = 0);
+
+    virtual double produce(const CalculationContext &context) const
+    {
+        auto e = expansion();
+        return e ? e->produce(context) : 0.;
+    }
+
+    virtual std::string toString() const
+    {
+        auto e = expansion();
+        return e ? e->toString() : "0";
+    }
+
+    virtual bool isParametrique(TokenType paramT, int deep) const
+    {
+        return _node->isParametrique(paramT, deep);
+    }
+
+    virtual std::shared_ptr<Operator> clone() const
+    {
+        return std::make_shared<DerivativeOf>(_node->clone(), _t, _deep);
+    }
+
+    // the next derevative is taken of the expansion, a lazy node of this one would expand to itself
+    virtual std::shared_ptr<Operator> derevative(TokenType t, int deep) const
+    {
+        return lazyDerevative(expansion(), t, deep);
+    }
+
+    virtual void addDeep()
+    {
+        _node->addDeep();
+        _deep++;
+        _expansion.reset();
+        _expanded = false;
+    }
+
+    bool isExpanded() const { return _expanded; }
+
+    // the derevative one level down, nullptr when it is zero
+    std::shared_ptr<Operator> expansion() const;
+
+    std::shared_ptr<Operator> _node;
+    TokenType _t;
+    int _deep = 0;
+
+private:
+    mutable std::shared_ptr<Operator> _expansion;
+    mutable bool _expanded = false;
+};
+
+// operands of op for graph walks: Functional gives its root, DerivativeOf its expansion
+std::vector<std::shared_ptr<Operator>> subOperators(const Operator *op);
+
+// constant of the type the parser gives for v, so derevatives simplify the same way
+std::shared_ptr<Operator> constantOperator(double v);
+
 struct TokenValue : public Token {
     TokenValue(TokenType type, double v) : Token(type), _v(v) {}
 
     double _v = 0.;
 };
 
+struct TokenFunction : public Token {
+    TokenFunction(const Intrinsic *intrinsic) : Token(TokenType::function), _intrinsic(intrinsic) {}
+
+    const Intrinsic *_intrinsic;
+};
+
 struct TokenGroup : public Token {
     TokenGroup(TokenType type) : Token(type) {}
 
@@ -495,8 +664,10 @@ class Equation {
         bool isValue = false;
         std::string buffer;
 
-        for(auto ch : script)
+        for(auto i = 0u; i < script.size(); i++)
         {
+            const auto ch = script[i];
+
             if(std::isdigit(ch) || ch == '.' || ch == ',')
             {
                 if(buffer.empty())
@@ -509,6 +680,16 @@ class Equation {
                 buffer.clear();
             }
 
+            if(buffer.empty())
+            {
+                if(auto intrinsic = IntrinsicRegistry::instance().findCall(script, i))
+                {
+                    res.emplace_back(std::make_shared<TokenFunction>(intrinsic));
+                    i += intrinsic->_name.size() - 1;
+                    continue;
+                }
+            }
+
             buffer.push_back(ch);
 
             auto it = g_TokenLiterals.find(buffer);
@@ -540,6 +721,7 @@ class Equation {
         static const std::list<Grammatic> s_Grammatics = {
             { TokenType::bracket_gr, {TokenType::left_bracket, TokenType::all, TokenType::right_bracket} },
             { TokenType::exp_gr, {TokenType::exp, TokenType::bracket_gr}},
+            { TokenType::function_gr, {TokenType::function, TokenType::bracket_gr}},
             { TokenType::ext_gr, {TokenType::bracket_gr, TokenType::ext, TokenType::any}},
             { TokenType::single_minus_gr, {TokenType::nothing, TokenType::minus, TokenType::any}},
             { TokenType::single_minus_gr, {TokenType::plus, TokenType::minus, TokenType::any}},
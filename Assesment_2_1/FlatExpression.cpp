@@ -0,0 +1,467 @@
+#include "FlatExpression.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace math {
+
+FlatExpression::Index FlatExpression::append(OpCode op, Index left, Index right, double v)
+{
+    NodeKey key{op, left, right, v};
+
+    auto it = _unique.find(key);
+    if(it != _unique.end())
+        return it->second;
+
+    if(_opcodes.size() >= std::numeric_limits<Index>::max())
+        throw std::runtime_error("Flat expression is too big");
+
+    const auto index = static_cast<Index>(_opcodes.size());
+
+    _opcodes.push_back(op);
+    _left.push_back(left);
+    _right.push_back(right);
+    _values.push_back(v);
+
+    _unique.emplace(key, index);
+    return index;
+}
+
+FlatExpression::Index FlatExpression::fromOperator(const Operator *op)
+{
+    if(!op)
+        throw std::runtime_error("Empty operator can't be flattened");
+
+    std::unordered_map<const Operator*, Index> converted;
+    std::vector<std::pair<const Operator*, bool>> stack = {{op, false}};
+
+    // post-order traversal without recursion, so graph depth isn't limited by the stack
+    while(!stack.empty())
+    {
+        auto [current, expanded] = stack.back();
+
+        if(converted.count(current))
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        std::vector<const Operator*> subs;
+        for(const auto &sub : subOperators(current))
+            subs.push_back(sub.get());
+
+        if(!expanded)
+        {
+            stack.back().second = true;
+
+            for(auto sub : subs)
+            {
+                if(!sub)
+                    throw std::runtime_error("Empty operator can't be flattened");
+
+                stack.emplace_back(sub, false);
+            }
+
+            continue;
+        }
+
+        stack.pop_back();
+
+        Index index = 0;
+
+        if(auto constantOp = current->to<ConstantOperator>())
+        {
+            index = append(OpCode::constant, 0, 0, constantOp->_v);
+        }
+        else if(auto variableOp = current->to<VariableOperator>())
+        {
+            index = append(OpCode::variable, static_cast<Index>(variableOp->_t), static_cast<Index>(variableOp->_deep), 0.);
+        }
+        else if(auto unaryOp = current->to<UnaryOperator>())
+        {
+            const auto sub = converted.at(subs[0]);
+
+            switch (unaryOp->_t) {
+            case TokenType::bracket_gr:
+                index = append(OpCode::bracket, sub, 0, 0.);
+                break;
+            case TokenType::exp:
+            case TokenType::exp_gr:
+                index = append(OpCode::exp, sub, 0, 0.);
+                break;
+            case TokenType::minus:
+                index = append(OpCode::negate, sub, 0, 0.);
+                break;
+            default:
+                throw std::runtime_error("Unsupported unary operator for flat expression");
+            }
+        }
+        else if(auto binaryOp = current->to<BinaryOperator>())
+        {
+            const auto left = converted.at(subs[0]);
+            const auto right = converted.at(subs[1]);
+
+            switch (binaryOp->_t) {
+            case TokenType::plus:
+                index = append(OpCode::plus, left, right, 0.);
+                break;
+            case TokenType::minus:
+                index = append(OpCode::minus, left, right, 0.);
+                break;
+            case TokenType::multipl:
+                index = append(OpCode::multipl, left, right, 0.);
+                break;
+            case TokenType::devision:
+                index = append(OpCode::devision, left, right, 0.);
+                break;
+            case TokenType::ext:
+                index = append(OpCode::ext, left, right, 0.);
+                break;
+            default:
+                throw std::runtime_error("Unsupported binary operator for flat expression");
+            }
+        }
+        else if(auto functionOp = current->to<FunctionOperator>())
+        {
+            const auto intrinsic = IntrinsicRegistry::instance().indexOf(functionOp->_intrinsic);
+            index = append(OpCode::function, converted.at(subs[0]), static_cast<Index>(intrinsic), 0.);
+        }
+        else if(current->to<Functional>())
+        {
+            index = converted.at(subs[0]);
+        }
+        else if(current->to<DerivativeOf>())
+        {
+            index = subs.empty() ? append(OpCode::constant, 0, 0, 0.) : converted.at(subs[0]);
+        }
+        else
+        {
+            throw std::runtime_error("Unsupported operator for flat expression");
+        }
+
+        converted[current] = index;
+    }
+
+    return converted.at(op);
+}
+
+std::shared_ptr<Operator> FlatExpression::toOperator(Index root) const
+{
+    if(root >= size())
+        throw std::runtime_error("Flat expression index is out of range");
+
+    // nodes reachable from the root, children precede parents, so the ascending order builds them bottom up
+    std::vector<bool> isReachable(root + 1, false);
+    isReachable[root] = true;
+    for(Index i = root + 1; i-- > 0;)
+    {
+        if(!isReachable[i] || isLeaf(i))
+            continue;
+
+        isReachable[_left[i]] = true;
+        if(isBinary(i))
+            isReachable[_right[i]] = true;
+    }
+
+    // one operator per node, so a shared node stays shared instead of being expanded again
+    std::vector<std::shared_ptr<Operator>> built(root + 1);
+
+    for(Index i = 0; i <= root; i++)
+    {
+        if(!isReachable[i])
+            continue;
+
+        const auto l = _left[i];
+        const auto r = _right[i];
+
+        switch (_opcodes[i]) {
+        case OpCode::constant:
+            built[i] = constantOperator(_values[i]);
+            break;
+        case OpCode::variable:
+            built[i] = std::make_shared<VariableOperator>(static_cast<TokenType>(l), static_cast<int>(r));
+            break;
+        case OpCode::bracket:
+            built[i] = std::make_shared<UnaryOperator>(TokenType::bracket_gr, built[l]);
+            break;
+        case OpCode::negate:
+            built[i] = std::make_shared<UnaryOperator>(TokenType::minus, built[l]);
+            break;
+        case OpCode::exp:
+            built[i] = std::make_shared<UnaryOperator>(TokenType::exp, built[l]);
+            break;
+        case OpCode::plus:
+            built[i] = std::make_shared<BinaryOperator>(TokenType::plus, built[l], built[r]);
+            break;
+        case OpCode::minus:
+            built[i] = std::make_shared<BinaryOperator>(TokenType::minus, built[l], built[r]);
+            break;
+        case OpCode::multipl:
+            built[i] = std::make_shared<BinaryOperator>(TokenType::multipl, built[l], built[r]);
+            break;
+        case OpCode::devision:
+            built[i] = std::make_shared<BinaryOperator>(TokenType::devision, built[l], built[r]);
+            break;
+        case OpCode::ext:
+            built[i] = std::make_shared<BinaryOperator>(TokenType::ext, built[l], built[r]);
+            break;
+        case OpCode::function:
+            built[i] = std::make_shared<FunctionOperator>(&IntrinsicRegistry::instance().at(r), built[l]);
+            break;
+        default:
+            throw std::runtime_error("Undefined flat expression opcode");
+        }
+    }
+
+    return built[root];
+}
+
+double FlatExpression::evaluate(Index i, const double *results, const CalculationContext &context) const
+{
+    const auto l = _left[i];
+    const auto r = _right[i];
+
+    switch (_opcodes[i]) {
+    case OpCode::constant:
+        return _values[i];
+    case OpCode::variable:
+        return context.value(static_cast<TokenType>(l), static_cast<int>(r));
+    case OpCode::bracket:
+        return results[l];
+    case OpCode::negate:
+        return -results[l];
+    case OpCode::exp:
+        return exp(results[l]);
+    case OpCode::plus:
+        return results[l] + results[r];
+    case OpCode::minus:
+        return results[l] - results[r];
+    case OpCode::multipl:
+        return results[l] * results[r];
+    case OpCode::devision:
+        return results[l] / results[r];
+    case OpCode::ext:
+        return pow(results[l], results[r]);
+    case OpCode::function:
+        return IntrinsicRegistry::instance().at(r)._scalar(results[l]);
+    }
+
+    throw std::runtime_error("Undefined flat expression opcode");
+}
+
+double FlatExpression::produce(Index root, const CalculationContext &context) const
+{
+    return produce(std::vector<Index>{root}, context)[0];
+}
+
+std::vector<double> FlatExpression::produce(const std::vector<Index> &roots, const CalculationContext &context) const
+{
+    Index last = 0;
+    for(auto root : roots)
+    {
+        if(root >= size())
+            throw std::runtime_error("Flat expression index is out of range");
+
+        last = std::max(last, root);
+    }
+
+    if(roots.empty())
+        return {};
+
+    // children precede parents, so one backward pass marks the nodes the roots reach
+    // and one forward pass evaluates them, the other nodes of the store are skipped
+    std::vector<bool> isReachable(last + 1, false);
+    for(auto root : roots)
+        isReachable[root] = true;
+
+    for(Index i = last + 1; i-- > 0;)
+    {
+        if(!isReachable[i] || isLeaf(i))
+            continue;
+
+        isReachable[_left[i]] = true;
+        if(isBinary(i))
+            isReachable[_right[i]] = true;
+    }
+
+    std::vector<double> results(last + 1);
+
+    for(Index i = 0; i <= last; i++)
+        if(isReachable[i])
+            results[i] = evaluate(i, results.data(), context);
+
+    std::vector<double> res;
+    res.reserve(roots.size());
+    for(auto root : roots)
+        res.push_back(results[root]);
+
+    return res;
+}
+
+std::vector<double> FlatExpression::produce(Index root, const std::vector<VariablesContext> &points) const
+{
+    if(root >= size())
+        throw std::runtime_error("Flat expression index is out of range");
+
+    // points are processed in chunks, so the columns of one chunk stay in cache
+    static const size_t s_ChunkSize = 256;
+
+    // a column lives from its node to the last node which reads it and its slot is reused
+    // after that, so the buffer holds only the columns alive at once, not one per node
+    std::vector<bool> isReachable(root + 1, false);
+    std::vector<Index> lastUse(root + 1, 0);
+    isReachable[root] = true;
+    lastUse[root] = root;
+
+    for(Index i = root + 1; i-- > 0;)
+    {
+        if(!isReachable[i] || isLeaf(i))
+            continue;
+
+        for(auto child : {_left[i], isBinary(i) ? _right[i] : _left[i]})
+        {
+            isReachable[child] = true;
+            lastUse[child] = std::max(lastUse[child], i);
+        }
+    }
+
+    std::vector<size_t> slotOf(root + 1, 0);
+    std::vector<size_t> freeSlots;
+    size_t slots = 0;
+
+    for(Index i = 0; i <= root; i++)
+    {
+        if(!isReachable[i])
+            continue;
+
+        // the output slot is taken before the children are released, kernels don't work in place
+        if(freeSlots.empty())
+            slotOf[i] = slots++;
+        else
+        {
+            slotOf[i] = freeSlots.back();
+            freeSlots.pop_back();
+        }
+
+        if(isLeaf(i))
+            continue;
+
+        if(lastUse[_left[i]] == i)
+            freeSlots.push_back(slotOf[_left[i]]);
+        if(isBinary(i) && _right[i] != _left[i] && lastUse[_right[i]] == i)
+            freeSlots.push_back(slotOf[_right[i]]);
+    }
+
+    std::vector<double> res(points.size());
+    std::vector<double> results(slots * s_ChunkSize);
+
+    for(size_t first = 0; first < points.size(); first += s_ChunkSize)
+    {
+        const auto n = std::min(s_ChunkSize, points.size() - first);
+
+        for(Index i = 0; i <= root; i++)
+        {
+            if(!isReachable[i])
+                continue;
+
+            double *out = results.data() + slotOf[i] * s_ChunkSize;
+            const double *lv = isLeaf(i) ? nullptr : results.data() + slotOf[_left[i]] * s_ChunkSize;
+            const double *rv = isBinary(i) ? results.data() + slotOf[_right[i]] * s_ChunkSize : nullptr;
+
+            switch (_opcodes[i]) {
+            case OpCode::constant:
+                std::fill(out, out + n, _values[i]);
+                break;
+            case OpCode::variable:
+                for(size_t p = 0; p < n; p++)
+                    out[p] = points[first + p].value(static_cast<TokenType>(_left[i]), static_cast<int>(_right[i]));
+                break;
+            case OpCode::bracket:
+                std::copy(lv, lv + n, out);
+                break;
+            case OpCode::negate:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = -lv[p];
+                break;
+            case OpCode::exp:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = exp(lv[p]);
+                break;
+            case OpCode::plus:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = lv[p] + rv[p];
+                break;
+            case OpCode::minus:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = lv[p] - rv[p];
+                break;
+            case OpCode::multipl:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = lv[p] * rv[p];
+                break;
+            case OpCode::devision:
+#pragma omp simd
+                for(size_t p = 0; p < n; p++)
+                    out[p] = lv[p] / rv[p];
+                break;
+            case OpCode::ext:
+                for(size_t p = 0; p < n; p++)
+                    out[p] = pow(lv[p], rv[p]);
+                break;
+            case OpCode::function:
+                IntrinsicRegistry::instance().at(_right[i])._batch(lv, out, n);
+                break;
+            }
+        }
+
+        const auto rootValues = results.begin() + slotOf[root] * s_ChunkSize;
+        std::copy(rootValues, rootValues + n, res.begin() + first);
+    }
+
+    return res;
+}
+
+size_t FlatExpression::bytes() const
+{
+    // the index of equal nodes: a bucket array and one heap node per entry with its cached hash
+    const auto uniqueBytes = _unique.bucket_count() * sizeof(void*)
+                             + _unique.size() * (sizeof(std::pair<const NodeKey, Index>) + sizeof(void*) + sizeof(size_t));
+
+    return _opcodes.capacity() * sizeof(OpCode) + (_left.capacity() + _right.capacity()) * sizeof(Index)
+           + _values.capacity() * sizeof(double) + uniqueBytes;
+}
+
+size_t FlatExpression::columnsBytes() const
+{
+    return _opcodes.capacity() * sizeof(OpCode) + (_left.capacity() + _right.capacity()) * sizeof(Index)
+           + _values.capacity() * sizeof(double);
+}
+
+void FlatExpression::releaseIndex()
+{
+    std::unordered_map<NodeKey, Index, NodeKeyHash>().swap(_unique);
+}
+
+void FlatExpression::reserve(size_t nodes)
+{
+    _opcodes.reserve(nodes);
+    _left.reserve(nodes);
+    _right.reserve(nodes);
+    _values.reserve(nodes);
+}
+
+void FlatExpression::clear()
+{
+    std::vector<OpCode>().swap(_opcodes);
+    std::vector<Index>().swap(_left);
+    std::vector<Index>().swap(_right);
+    std::vector<double>().swap(_values);
+    std::unordered_map<NodeKey, Index, NodeKeyHash>().swap(_unique);
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Equation.h"
+
+namespace math {
+
+// Struct-of-arrays storage for expression graphs.
+// Nodes live in parallel columns and reference their children by 32-bit index,
+// children always have smaller indices than their parents. For variable nodes
+// _left keeps the TokenType and _right keeps the deep, for function nodes _right keeps
+// the IntrinsicRegistry index. Equal subtrees are stored once.
+class FlatExpression {
+public:
+    using Index = uint32_t;
+
+    enum class OpCode : uint8_t {
+        constant = 0,
+        variable,
+        bracket,
+        negate,
+        exp,
+        plus,
+        minus,
+        multipl,
+        devision,
+        ext,
+        function
+    };
+
+    // appends the operator graph to the columns and returns index of its root
+    Index fromOperator(const Operator *op);
+    Index fromOperator(const std::shared_ptr<Operator> &op) { return fromOperator(op.get()); }
+
+    // equal subtrees are stored once and come back as one shared operator
+    std::shared_ptr<Operator> toOperator(Index root) const;
+
+    double produce(Index root, const CalculationContext &context) const;
+    std::vector<double> produce(const std::vector<Index> &roots, const CalculationContext &context) const;
+
+    // evaluates the root for many points at once, column by column, using batch kernels
+    std::vector<double> produce(Index root, const std::vector<VariablesContext> &points) const;
+
+    // value of node i when values of its children are already in results
+    double evaluate(Index i, const double *results, const CalculationContext &context) const;
+
+    bool isLeaf(Index i) const { return _opcodes[i] == OpCode::constant || _opcodes[i] == OpCode::variable; }
+    bool isBinary(Index i) const { return _opcodes[i] >= OpCode::plus && _opcodes[i] <= OpCode::ext; }
+
+    size_t size() const { return _opcodes.size(); }
+
+    // the columns and the index of equal nodes
+    size_t bytes() const;
+    size_t columnsBytes() const;
+
+    // drops the index of equal nodes once the graph is built, later nodes are not deduplicated
+    // against the earlier ones but everything else works as before
+    void releaseIndex();
+
+    void reserve(size_t nodes);
+
+    // releases all nodes at once
+    void clear();
+
+    std::vector<OpCode> _opcodes;
+    std::vector<Index> _left;
+    std::vector<Index> _right;
+    std::vector<double> _values;
+
+private:
+    struct NodeKey {
+        OpCode _op;
+        Index _left;
+        Index _right;
+        double _v;
+
+        bool operator==(const NodeKey &other) const
+        {
+            return _op == other._op && _left == other._left && _right == other._right && _v == other._v;
+        }
+    };
+
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey &key) const
+        {
+            size_t h = static_cast<size_t>(key._op);
+            h = h * 1000003u ^ key._left;
+            h = h * 1000003u ^ key._right;
+            h = h * 1000003u ^ std::hash<double>()(key._v);
+            return h;
+        }
+    };
+
+    Index append(OpCode op, Index left, Index right, double v);
+
+    std::unordered_map<NodeKey, Index, NodeKeyHash> _unique;
+};
+
+}
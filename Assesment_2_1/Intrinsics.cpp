@@ -0,0 +1,157 @@
+#include "Intrinsics.h"
+
+#include <cmath>
+
+#include "Equation.h"
+
+namespace math {
+
+namespace {
+
+double sigmoid(double v)
+{
+    return 1. / (1. + std::exp(-v));
+}
+
+double logScalar(double v) { return std::log(v); }
+double sqrtScalar(double v) { return std::sqrt(v); }
+double tanhScalar(double v) { return std::tanh(v); }
+double sinScalar(double v) { return std::sin(v); }
+double cosScalar(double v) { return std::cos(v); }
+
+// batch kernels walk contiguous arrays so the compiler can map them onto SIMD lanes
+void logBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = std::log(in[i]);
+}
+
+void sqrtBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = std::sqrt(in[i]);
+}
+
+void tanhBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = std::tanh(in[i]);
+}
+
+void sigmoidBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = 1. / (1. + std::exp(-in[i]));
+}
+
+void sinBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = std::sin(in[i]);
+}
+
+void cosBatch(const double *in, double *out, size_t n)
+{
+#pragma omp simd
+    for(size_t i = 0; i < n; i++)
+        out[i] = std::cos(in[i]);
+}
+
+std::shared_ptr<Operator> call(const std::string &name, std::shared_ptr<Operator> u)
+{
+    return std::make_shared<FunctionOperator>(IntrinsicRegistry::instance().find(name), u);
+}
+
+std::shared_ptr<Operator> bracket(std::shared_ptr<Operator> op)
+{
+    return std::make_shared<UnaryOperator>(TokenType::bracket_gr, op);
+}
+
+}
+
+IntrinsicRegistry &IntrinsicRegistry::instance()
+{
+    static IntrinsicRegistry s_Registry;
+    return s_Registry;
+}
+
+IntrinsicRegistry::IntrinsicRegistry()
+{
+    add({ "log", [](std::shared_ptr<Operator> u){
+              return bracket(std::make_shared<OneValueOperator>() / u);
+          }, &logScalar, &logBatch });
+
+    add({ "sqrt", [](std::shared_ptr<Operator> u){
+              return bracket(std::make_shared<OneValueOperator>() / bracket(std::make_shared<SquareOperator>() * call("sqrt", u)));
+          }, &sqrtScalar, &sqrtBatch });
+
+    add({ "tanh", [](std::shared_ptr<Operator> u){
+              return bracket(std::make_shared<OneValueOperator>() - (call("tanh", u) ^ std::make_shared<SquareOperator>()));
+          }, &tanhScalar, &tanhBatch });
+
+    add({ "sigmoid", [](std::shared_ptr<Operator> u){
+              auto s = call("sigmoid", u);
+              return s * bracket(std::make_shared<OneValueOperator>() - s);
+          }, &sigmoid, &sigmoidBatch });
+
+    add({ "sin", [](std::shared_ptr<Operator> u){
+              return call("cos", u);
+          }, &sinScalar, &sinBatch });
+
+    add({ "cos", [](std::shared_ptr<Operator> u){
+              return bracket(std::make_shared<UnaryOperator>(TokenType::minus, call("sin", u)));
+          }, &cosScalar, &cosBatch });
+}
+
+size_t IntrinsicRegistry::add(Intrinsic intrinsic)
+{
+    if(intrinsic._name.empty() || !intrinsic._scalar || !intrinsic._batch || !intrinsic._derevative)
+        throw std::runtime_error("Intrinsic function should have name, derevative and kernels");
+
+    if(g_TokenLiterals.count(intrinsic._name) || _names.count(intrinsic._name))
+        throw std::runtime_error("Function is already defined: " + intrinsic._name);
+
+    const auto index = _intrinsics.size();
+    _names[intrinsic._name] = index;
+    _intrinsics.emplace_back(std::make_unique<Intrinsic>(std::move(intrinsic)));
+
+    return index;
+}
+
+const Intrinsic *IntrinsicRegistry::find(const std::string &name) const
+{
+    auto it = _names.find(name);
+    return it != _names.end() ? _intrinsics[it->second].get() : nullptr;
+}
+
+const Intrinsic *IntrinsicRegistry::findCall(const std::string &script, size_t position) const
+{
+    const Intrinsic *res = nullptr;
+
+    for(const auto &intrinsic : _intrinsics)
+    {
+        const auto &name = intrinsic->_name;
+        const auto end = position + name.size();
+
+        if(end < script.size() && script[end] == '(' && script.compare(position, name.size(), name) == 0
+           && (!res || name.size() > res->_name.size()))
+            res = intrinsic.get();
+    }
+
+    return res;
+}
+
+size_t IntrinsicRegistry::indexOf(const Intrinsic *intrinsic) const
+{
+    if(!intrinsic)
+        throw std::runtime_error("Undefined function");
+
+    return _names.at(intrinsic->_name);
+}
+
+}
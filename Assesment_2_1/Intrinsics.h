@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace math {
+
+class Operator;
+
+// named function of one argument, usable in scripts as name(...)
+struct Intrinsic {
+    std::string _name;
+    // builds f'(u) for the argument u, the chain rule is applied by FunctionOperator
+    std::function<std::shared_ptr<Operator>(std::shared_ptr<Operator> u)> _derevative;
+    double (*_scalar)(double) = nullptr;
+    void (*_batch)(const double *in, double *out, size_t n) = nullptr;
+};
+
+class IntrinsicRegistry {
+public:
+    static IntrinsicRegistry &instance();
+
+    // returns index of the registered function; names should be unique
+    size_t add(Intrinsic intrinsic);
+
+    const Intrinsic *find(const std::string &name) const;
+
+    // the longest name which starts at the position and is followed by '(', so a call
+    // like expm1(...) is not split by a shorter literal or function name at its beginning
+    const Intrinsic *findCall(const std::string &script, size_t position) const;
+    const Intrinsic &at(size_t index) const { return *_intrinsics.at(index); }
+    size_t indexOf(const Intrinsic *intrinsic) const;
+    size_t size() const { return _intrinsics.size(); }
+
+private:
+    IntrinsicRegistry();
+
+    std::vector<std::unique_ptr<Intrinsic>> _intrinsics;
+    std::unordered_map<std::string, size_t> _names;
+};
+
+}
@@ -0,0 +1,88 @@
+#include "ParallelEvaluator.h"
+
+#include <algorithm>
+
+namespace math {
+
+ParallelEvaluator::ParallelEvaluator(const FlatExpression &flat, const std::vector<FlatExpression::Index> &roots, size_t threads)
+    : _flat(flat), _roots(roots), _pool(threads)
+{
+    if(roots.empty())
+        throw std::runtime_error("Nothing to evaluate");
+
+    const auto last = *std::max_element(roots.begin(), roots.end());
+    if(last >= flat.size())
+        throw std::runtime_error("Flat expression index is out of range");
+
+    const auto count = static_cast<size_t>(last) + 1;
+
+    // children have smaller indices, so reachability goes down and levels go up in index order
+    std::vector<char> reachable(count, 0);
+    for(auto root : roots)
+        reachable[root] = 1;
+
+    for(auto i = count; i-- > 0;)
+    {
+        if(!reachable[i] || flat.isLeaf(i))
+            continue;
+
+        reachable[flat._left[i]] = 1;
+        if(flat.isBinary(i))
+            reachable[flat._right[i]] = 1;
+    }
+
+    std::vector<uint32_t> levels(count, 0);
+    uint32_t maxLevel = 0;
+
+    for(FlatExpression::Index i = 0; i < count; i++)
+    {
+        if(!reachable[i] || flat.isLeaf(i))
+            continue;
+
+        auto level = levels[flat._left[i]] + 1;
+        if(flat.isBinary(i))
+            level = std::max(level, levels[flat._right[i]] + 1);
+
+        levels[i] = level;
+        maxLevel = std::max(maxLevel, level);
+    }
+
+    _levelOffsets.assign(maxLevel + 2, 0);
+    for(FlatExpression::Index i = 0; i < count; i++)
+        if(reachable[i])
+            _levelOffsets[levels[i] + 1]++;
+
+    for(auto k = 1u; k < _levelOffsets.size(); k++)
+        _levelOffsets[k] += _levelOffsets[k - 1];
+
+    _order.resize(_levelOffsets.back());
+    auto positions = _levelOffsets;
+    for(FlatExpression::Index i = 0; i < count; i++)
+        if(reachable[i])
+            _order[positions[levels[i]]++] = i;
+
+    _results.resize(count);
+}
+
+double ParallelEvaluator::produce(const CalculationContext &context)
+{
+    double *results = _results.data();
+
+    for(auto k = 0u; k + 1 < _levelOffsets.size(); k++)
+    {
+        const auto first = _levelOffsets[k];
+        const auto n = _levelOffsets[k + 1] - first;
+
+        _pool.parallelFor(n, _chunkSize, [&](size_t begin, size_t end){
+            for(auto j = begin; j < end; j++)
+            {
+                const auto i = _order[first + j];
+                results[i] = _flat.evaluate(i, results, context);
+            }
+        });
+    }
+
+    return results[_roots.front()];
+}
+
+}
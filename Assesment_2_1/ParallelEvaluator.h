@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "FlatExpression.h"
+#include "ThreadPool.h"
+
+namespace math {
+
+// Evaluates one huge expression graph without recursion. Nodes reachable from the roots
+// are grouped by level (longest distance from a leaf); nodes of one level don't depend
+// on each other, so every level is evaluated in parallel chunks on the thread pool.
+// Several roots are evaluated in one sweep, the nodes they share are evaluated once.
+class ParallelEvaluator {
+public:
+    ParallelEvaluator(const FlatExpression &flat, const std::vector<FlatExpression::Index> &roots,
+                      size_t threads = std::thread::hardware_concurrency());
+
+    ParallelEvaluator(const FlatExpression &flat, FlatExpression::Index root,
+                      size_t threads = std::thread::hardware_concurrency())
+        : ParallelEvaluator(flat, std::vector<FlatExpression::Index>{root}, threads) {}
+
+    // evaluates every root and returns the value of the first one
+    double produce(const CalculationContext &context);
+
+    // value of the k-th root after produce
+    double value(size_t k) const { return _results[_roots[k]]; }
+
+    size_t levelsCount() const { return _levelOffsets.size() - 1; }
+    size_t nodesCount() const { return _order.size(); }
+    size_t threadsCount() const { return _pool.size(); }
+
+    // levels with fewer nodes are evaluated by the calling thread
+    size_t _chunkSize = 4096;
+
+private:
+    const FlatExpression &_flat;
+    std::vector<FlatExpression::Index> _roots;
+
+    // nodes ordered by level, level k occupies [_levelOffsets[k], _levelOffsets[k + 1])
+    std::vector<FlatExpression::Index> _order;
+    std::vector<size_t> _levelOffsets;
+    std::vector<double> _results;
+
+    ThreadPool _pool;
+};
+
+}
@@ -0,0 +1,136 @@
+#include "Recurrence.h"
+
+namespace math {
+
+namespace {
+
+// shifts deep of the step variables and provides phi(i-1) of the previous step
+class StepContext : public CalculationContext {
+public:
+    StepContext(const CalculationContext &outer, int deep, double phi)
+        : CalculationContext(outer._parameterV), _outer(outer), _deep(deep), _phi(phi) {}
+
+    virtual double value(TokenType t, int deep) const
+    {
+        if(t == TokenType::phi_i_1)
+            return _phi;
+
+        return _outer.value(t, _deep + deep);
+    }
+
+    const CalculationContext &_outer;
+    int _deep = 0;
+    double _phi = 0;
+};
+
+const TokenType g_Parameters[] = { TokenType::var_xi, TokenType::var_mi, TokenType::var_di };
+
+}
+
+Recurrence::Recurrence(const std::string &initialScript, const std::string &stepScript,
+                       int iterations, bool sharedParameters, const Simplify &simplify)
+    : _iterations(iterations), _sharedParameters(sharedParameters)
+{
+    if(iterations < 0)
+        throw std::runtime_error("Number of iterations should not be negative");
+
+    compile(_initial, initialScript, false, simplify);
+    compile(_step, stepScript, true, simplify);
+}
+
+void Recurrence::compile(Step &step, const std::string &script, bool withPhi, const Simplify &simplify)
+{
+    Equation eq;
+    eq.parse(script);
+
+    const auto root = eq._sintaxis_tree_root;
+
+    if(!withPhi && root->isParametrique(TokenType::phi_i_1))
+        throw std::runtime_error("Initial equation should not depend on phi(i-1): " + script);
+
+    auto flatten = [&step, &simplify](const OperatorPtr &op){
+        return step._flat.fromOperator(simplify ? simplify(op) : op);
+    };
+
+    step._value = flatten(root);
+
+    for(auto t : g_Parameters)
+    {
+        if(!root->isParametrique(t))
+            continue;
+
+        if(auto dv = root->derevative(t))
+            step._derevatives.emplace_back(t, flatten(dv));
+    }
+
+    if(withPhi && root->isParametrique(TokenType::phi_i_1))
+    {
+        if(auto dv = root->derevative(TokenType::phi_i_1))
+        {
+            step._byPhi = flatten(dv);
+            step._hasByPhi = true;
+        }
+    }
+}
+
+std::vector<double> Recurrence::forward(const CalculationContext &context) const
+{
+    std::vector<double> phi(_iterations + 1);
+
+    phi[0] = _initial._flat.produce(_initial._value, StepContext(context, deepOfStep(0), 0.));
+
+    for(auto s = 1; s <= _iterations; s++)
+        phi[s] = _step._flat.produce(_step._value, StepContext(context, deepOfStep(s), phi[s - 1]));
+
+    return phi;
+}
+
+double Recurrence::produce(const CalculationContext &context) const
+{
+    return forward(context).back();
+}
+
+std::vector<double> Recurrence::gradient(TokenType t, const CalculationContext &context) const
+{
+    const auto phi = forward(context);
+
+    std::vector<double> res(_sharedParameters ? 1 : _iterations + 1, 0.);
+    double adjoint = 1.;
+
+    // reverse accumulation: adjoint keeps dphi_N/dphi_s
+    for(auto s = _iterations; s >= 0; s--)
+    {
+        const auto &step = s ? _step : _initial;
+        const StepContext stepContext(context, deepOfStep(s), s ? phi[s - 1] : 0.);
+
+        std::vector<FlatExpression::Index> roots;
+        for(const auto &dv : step._derevatives)
+            if(dv.first == t)
+                roots.push_back(dv.second);
+
+        const bool hasByT = !roots.empty();
+        if(s && step._hasByPhi)
+            roots.push_back(step._byPhi);
+
+        if(roots.empty())
+        {
+            adjoint = 0.;
+            break;
+        }
+
+        const auto values = step._flat.produce(roots, stepContext);
+
+        if(hasByT)
+            res[_sharedParameters ? 0 : _iterations - s] += adjoint * values[0];
+
+        if(s)
+            adjoint = step._hasByPhi ? adjoint * values.back() : 0.;
+
+        if(adjoint == 0.)
+            break;
+    }
+
+    return res;
+}
+
+}
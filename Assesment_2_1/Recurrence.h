@@ -0,0 +1,51 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Equation.h"
+#include "FlatExpression.h"
+
+namespace math {
+
+// phi_0 = f0(xi, mi, di), phi_s = f(xi, mi, di, phi(i-1)) for s = 1..N.
+// Both scripts are parsed once, phi(i-1) stays a variable of the step equation.
+// Step s reads parameters of deep N - s (or deep 0 when parameters are shared),
+// so phi_N is evaluated in O(N) without building the nested expression tree.
+class Recurrence {
+public:
+    // applied to every compiled expression, e.g. the e-graph optimizer
+    using Simplify = std::function<OperatorPtr(const OperatorPtr &)>;
+
+    Recurrence(const std::string &initialScript, const std::string &stepScript,
+               int iterations, bool sharedParameters = false, const Simplify &simplify = nullptr);
+
+    double produce(const CalculationContext &context) const;
+
+    // res[k] = dphi_N/dt(i-k), accumulated backwards through the iterations;
+    // with shared parameters only res[0] is filled
+    std::vector<double> gradient(TokenType t, const CalculationContext &context) const;
+
+    int iterations() const { return _iterations; }
+
+private:
+    struct Step {
+        FlatExpression _flat;
+        FlatExpression::Index _value = 0;
+        std::vector<std::pair<TokenType, FlatExpression::Index>> _derevatives;
+        FlatExpression::Index _byPhi = 0;
+        bool _hasByPhi = false;
+    };
+
+    void compile(Step &step, const std::string &script, bool withPhi, const Simplify &simplify);
+    int deepOfStep(int step) const { return _sharedParameters ? 0 : _iterations - step; }
+    std::vector<double> forward(const CalculationContext &context) const;
+
+    Step _initial;
+    Step _step;
+    int _iterations = 0;
+    bool _sharedParameters = false;
+};
+
+}
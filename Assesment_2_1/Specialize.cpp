@@ -0,0 +1,91 @@
+#include "Specialize.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace math {
+
+namespace {
+
+bool isConstant(const OperatorPtr &op)
+{
+    return op->to<ConstantOperator>() != nullptr;
+}
+
+}
+
+OperatorPtr specialize(const OperatorPtr &op, const Bindings &bindings)
+{
+    if(!op)
+        throw std::runtime_error("Empty operator can't be specialized");
+
+    std::unordered_map<const Operator*, OperatorPtr> specialized;
+    std::vector<std::pair<OperatorPtr, bool>> stack = {{op, false}};
+
+    // post-order traversal without recursion, as FlatExpression::fromOperator
+    while(!stack.empty())
+    {
+        auto [current, expanded] = stack.back();
+
+        if(specialized.count(current.get()))
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        const auto subs = subOperators(current.get());
+
+        if(!expanded)
+        {
+            stack.back().second = true;
+
+            for(const auto &sub : subs)
+            {
+                if(!sub)
+                    throw std::runtime_error("Empty operator can't be specialized");
+
+                stack.emplace_back(sub, false);
+            }
+
+            continue;
+        }
+
+        stack.pop_back();
+
+        auto sub = [&](size_t i){ return specialized.at(subs[i].get()); };
+        OperatorPtr res;
+
+        if(current->to<ConstantOperator>())
+            res = current->clone();
+        else if(auto variableOp = current->to<VariableOperator>())
+        {
+            auto it = bindings.find({variableOp->_t, variableOp->_deep});
+            res = it != bindings.end() ? constantOperator(it->second) : current->clone();
+        }
+        else if(auto unaryOp = current->to<UnaryOperator>())
+            res = std::make_shared<UnaryOperator>(unaryOp->_t, sub(0));
+        else if(auto binaryOp = current->to<BinaryOperator>())
+            res = std::make_shared<BinaryOperator>(binaryOp->_t, sub(0), sub(1));
+        else if(auto functionOp = current->to<FunctionOperator>())
+            res = std::make_shared<FunctionOperator>(functionOp->_intrinsic, sub(0));
+        else if(current->to<Functional>() || current->to<DerivativeOf>())
+            res = subs.empty() ? constantOperator(0.) : sub(0);
+        else
+            throw std::runtime_error("Unsupported operator for specialization");
+
+        // no variables are left under the operator, its value is the same for every context
+        const auto isFolded = !subs.empty() && std::all_of(subs.begin(), subs.end(), [&](const OperatorPtr &s){
+            return isConstant(specialized.at(s.get()));
+        });
+
+        if(isFolded && !isConstant(res))
+            res = constantOperator(res->produce(CalculationContext(0.)));
+
+        specialized.emplace(current.get(), res);
+    }
+
+    return specialized.at(op.get());
+}
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "Equation.h"
+
+namespace math {
+
+// values of the variables held fixed, by type and deep
+using Bindings = std::map<std::pair<TokenType, int>, double>;
+
+// Residual of op for the bindings: bound variables become constants and every subtree
+// which depends on bound variables only is folded into one ConstantOperator, so producing
+// the residual costs only the part which depends on the free variables.
+// Shared subtrees stay shared, nothing is shared with op. Derevatives of the residual by the
+// free variables are the specialized derevatives of op, by the bound ones they are zero.
+OperatorPtr specialize(const OperatorPtr &op, const Bindings &bindings);
+
+}
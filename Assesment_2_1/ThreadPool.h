@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace math {
+
+// fixed set of workers for data-parallel loops, the calling thread takes part in every loop
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+    {
+        for(auto i = 1u; i < std::max<size_t>(threads, 1); i++)
+            _workers.emplace_back([this](){ work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _wake.notify_all();
+
+        for(auto &worker : _workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return _workers.size() + 1; }
+
+    // runs body(begin, end) for chunks of [0, n) and returns when all of them are done
+    void parallelFor(size_t n, size_t chunk, const std::function<void(size_t, size_t)> &body)
+    {
+        if(!n)
+            return;
+
+        chunk = std::max<size_t>(chunk, 1);
+
+        if(_workers.empty() || n <= chunk)
+        {
+            body(0, n);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _body = &body;
+            _n = n;
+            _chunk = chunk;
+            _next = 0;
+            _active = _workers.size();
+            _error = nullptr;
+            _generation++;
+        }
+
+        _wake.notify_all();
+        runChunks();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this](){ return _active == 0; });
+        _body = nullptr;
+
+        if(_error)
+            std::rethrow_exception(_error);
+    }
+
+private:
+    void runChunks()
+    {
+        for(;;)
+        {
+            const auto begin = _next.fetch_add(_chunk);
+            if(begin >= _n)
+                break;
+
+            try {
+                (*_body)(begin, std::min(_n, begin + _chunk));
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(!_error)
+                    _error = std::current_exception();
+            }
+        }
+    }
+
+    void work()
+    {
+        uint64_t seenGeneration = 0;
+
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [&](){ return _stop || _generation != seenGeneration; });
+
+                if(_stop)
+                    return;
+
+                seenGeneration = _generation;
+            }
+
+            runChunks();
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(--_active == 0)
+                _done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+
+    const std::function<void(size_t, size_t)> *_body = nullptr;
+    size_t _n = 0;
+    size_t _chunk = 1;
+    std::atomic<size_t> _next{0};
+    size_t _active = 0;
+    uint64_t _generation = 0;
+    bool _stop = false;
+    std::exception_ptr _error;
+};
+
+}
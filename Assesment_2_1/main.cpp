@@ -1,19 +1,170 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <tuple>
+#include <chrono>
+#include <cmath>
+#include <limits>
 
 #include "Equation.h"
+#include "EGraph.h"
+#include "FlatExpression.h"
+#include "Recurrence.h"
+#include "ParallelEvaluator.h"
+#include "Specialize.h"
 
 using namespace std;
 
-void equations_test()
+static const std::string g_Phi0Script = "exp((-(xi-mi)^2)/(2*di^2))";
+static const std::string g_PhiStepScript = "exp((-(xi-mi)^2)/(2*di^2))+exp((-(phi(i-1)-mi)^2)/(2*di^2))";
+
+struct Options {
+    bool _optimize = false;
+    math::CostModel _cost;
+    math::EGraphLimits _limits;
+    std::vector<double> _evaluateAt;
+    bool _evaluateGraph = false;
+    size_t _threads = std::thread::hardware_concurrency();
+};
+
+Options parseOptions(int argc, char* argv[], int first)
+{
+    Options res;
+
+    for(auto i = first; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+
+        if(arg == "--optimize" || arg == "--optimize=nodes")
+        {
+            res._optimize = true;
+            res._cost = math::CostModel(math::CostModel::Kind::nodeCount);
+        }
+        else if(arg == "--optimize=flops")
+        {
+            res._optimize = true;
+            res._cost = math::CostModel(math::CostModel::Kind::flops);
+        }
+        else if(arg.rfind("--max-nodes=", 0) == 0)
+            res._limits._maxNodes = std::stoul(arg.substr(arg.find('=') + 1));
+        else if(arg.rfind("--max-iterations=", 0) == 0)
+            res._limits._maxIterations = std::stoul(arg.substr(arg.find('=') + 1));
+        else if(arg.rfind("--evaluate=", 0) == 0)
+        {
+            std::istringstream values(arg.substr(arg.find('=') + 1));
+            std::string value;
+            while(std::getline(values, value, ','))
+                res._evaluateAt.push_back(std::stod(value));
+
+            if(res._evaluateAt.size() != 3)
+                throw std::runtime_error("Expected --evaluate=xi,mi,di");
+        }
+        else if(arg == "--graph")
+            res._evaluateGraph = true;
+        else if(arg.rfind("--threads=", 0) == 0)
+            res._threads = std::stoul(arg.substr(arg.find('=') + 1));
+        else
+            throw std::runtime_error("Unknown option: " + arg);
+    }
+
+    return res;
+}
+
+// the expression which is printed and evaluated, optimized with --optimize
+math::OperatorPtr prepare(const Options &options, math::OperatorPtr op)
+{
+    if(op && options._optimize)
+        op = math::optimize(op, options._cost, options._limits);
+
+    return op;
+}
+
+std::string present(const Options &options, math::OperatorPtr op)
+{
+    op = prepare(options, op);
+    return op ? op->toString() : "zero";
+}
+
+// difference relative to the size of the expected value, NaN on one side only is a difference too
+double relativeError(double actual, double expected)
+{
+    if(std::isnan(actual) || std::isnan(expected))
+        return std::isnan(actual) == std::isnan(expected) ? 0. : std::numeric_limits<double>::infinity();
+
+    if(actual == expected)
+        return 0.;
+
+    return fabs(actual - expected) / std::max(1., fabs(expected));
+}
+
+int check(const std::string &what, double actual, double expected, double tolerance = 1e-12)
+{
+    if(relativeError(actual, expected) <= tolerance)
+        return 0;
+
+    std::cerr << what << ": " << actual << " instead of " << expected << std::endl;
+    return 1;
+}
+
+// central difference of op by the variable t of this step
+double difference(const math::OperatorPtr &op, math::TokenType t, math::VariablesContext point)
 {
-    auto testEq = [](auto eqString, auto derBy){
+    const double h = 1e-6;
+    const auto v = point.value(t, 0);
+
+    point.set(t, 0, v + h);
+    const auto right = op->produce(point);
+    point.set(t, 0, v - h);
+
+    return (right - op->produce(point)) / (2 * h);
+}
+
+int equations_test()
+{
+    auto failures = 0;
+
+    // points with negative and non-trivial values, where rewrites which hold only for some values show up
+    std::vector<math::VariablesContext> points;
+    for(auto [xi, mi, di] : {std::make_tuple(0.7, 0.2, 0.9), std::make_tuple(-1.3, 0.4, 1.7),
+                             std::make_tuple(-0.4, -0.8, 0.6), std::make_tuple(2.1, 1.5, -1.1)})
+    {
+        math::VariablesContext point;
+        point.set(math::TokenType::var_xi, 0, xi);
+        point.set(math::TokenType::var_mi, 0, mi);
+        point.set(math::TokenType::var_di, 0, di);
+        points.push_back(point);
+    }
+
+    auto maxError = [&points](const math::OperatorPtr &expected, const math::OperatorPtr &actual){
+        double res = 0.;
+        for(const auto &point : points)
+            res = std::max(res, relativeError(actual->produce(point), expected->produce(point)));
+
+        return res;
+    };
+
+    auto testEq = [&](auto eqString, auto derBy){
         math::Equation eq1;
         eq1.parse(eqString);
 
         std::cout << "Equation: " << eq1._sintaxis_tree_root->toString() << std::endl;
         auto dv = eq1._sintaxis_tree_root->derevative(derBy);
         std::cout << "Has derevative: " << (dv ? dv->toString() : "zero") << std::endl;
+
+        for(const auto &point : points)
+            failures += check(std::string("Derevative of ") + eqString + " against differences",
+                              dv ? dv->produce(point) : 0., difference(eq1._sintaxis_tree_root, derBy, point), 1e-6);
+
+        auto optimizedEq = math::optimize(eq1._sintaxis_tree_root, math::CostModel(math::CostModel::Kind::flops));
+        std::cout << "Optimized equation: " << optimizedEq->toString() << std::endl;
+        failures += check(std::string("Optimized ") + eqString + ", max error", maxError(eq1._sintaxis_tree_root, optimizedEq), 0.);
+
+        if(dv)
+        {
+            auto optimized = math::optimize(dv, math::CostModel(math::CostModel::Kind::flops));
+            std::cout << "Optimized derevative: " << optimized->toString() << std::endl;
+            failures += check(std::string("Optimized derevative of ") + eqString + ", max error", maxError(dv, optimized), 0.);
+        }
     };
 
     testEq("1", math::TokenType::var_xi);
@@ -30,9 +181,17 @@ void equations_test()
     testEq("exp((-(xi-mi)^2)/(2*di^2))", math::TokenType::var_xi);
     testEq("exp((-(xi-mi)^2)/(2*di^2))", math::TokenType::var_di);
     testEq("exp((-(xi-mi)^2)/(2*di^2))", math::TokenType::var_mi);
+    testEq("(xi^2)^0.5", math::TokenType::var_xi);
 
-    std::string dummy;
-    std::cin >> dummy;
+    // constants close to 0 and 1 and fractional powers of negative values, which rewrites should leave alone
+    testEq("xi*0.0000001", math::TokenType::var_xi);
+    testEq("xi+0.0000001", math::TokenType::var_xi);
+    testEq("xi^1.0000001", math::TokenType::var_xi);
+    testEq("xi^0.0000001", math::TokenType::var_xi);
+    testEq("(xi^0.5)^2", math::TokenType::var_xi);
+    testEq("xi^0.5*xi^0.5", math::TokenType::var_xi);
+
+    return failures;
 }
 
 void iterable_equations_test()
@@ -50,7 +209,7 @@ void iterable_equations_test()
     for(auto i = 0; i < i_number_iterations; i++)
     {
         math::Equation eqNextStep(eq._sintaxis_tree_root, true);
-        eqNextStep.parse("exp((-(xi-mi)^2)/(2*di^2))+exp((-(phi(i-1)-mi)^2)/(2*di^2))");
+        eqNextStep.parse(g_PhiStepScript);
 
         std::cout << "Equation: " << eqNextStep._sintaxis_tree_root->toString() << std::endl;
         auto dv = eqNextStep._sintaxis_tree_root->derevative(derBy);
@@ -58,6 +217,533 @@ void iterable_equations_test()
     }
 }
 
+int flat_expressions_test()
+{
+    auto failures = 0;
+
+    math::Equation eq;
+    eq.parse("exp((-(xi-mi)^2)/(2*di^2))");
+
+    auto phi = eq._sintaxis_tree_root;
+    for(auto i = 0; i < 3; i++)
+    {
+        math::Equation eqNextStep(phi, true);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    auto dv = phi->derevative(math::TokenType::var_mi, 1);
+
+    math::FlatExpression flat;
+    const auto root = flat.fromOperator(dv);
+    const auto restored = flat.toOperator(root);
+    const math::CalculationContext context(0.3);
+
+    std::cout << "Flat expression: " << flat.size() << " nodes, " << flat.bytes() << " bytes, "
+              << flat.columnsBytes() << " without the index" << std::endl;
+
+    if(restored->toString() != dv->toString())
+    {
+        failures++;
+        std::cerr << "Flat round trip gives " << restored->toString() << " instead of " << dv->toString() << std::endl;
+    }
+
+    failures += check("Flat value", flat.produce(root, context), dv->produce(context));
+    failures += check("Flat round trip value", restored->produce(context), dv->produce(context));
+
+    // 2^40 paths through 41 shared nodes come back as 41 operators
+    math::OperatorPtr doubled = std::make_shared<math::VariableOperator>(math::TokenType::var_xi);
+    for(auto i = 0; i < 40; i++)
+        doubled = std::make_shared<math::BinaryOperator>(math::TokenType::plus, doubled, doubled);
+
+    math::FlatExpression shared;
+    const auto doubledRoot = shared.fromOperator(doubled);
+    shared.releaseIndex();
+
+    math::FlatExpression sharedAgain;
+    sharedAgain.fromOperator(shared.toOperator(doubledRoot));
+    if(shared.size() != 41 || sharedAgain.size() != 41)
+    {
+        failures++;
+        std::cerr << "Shared round trip: " << shared.size() << " nodes to " << sharedAgain.size() << " instead of 41" << std::endl;
+    }
+
+    failures += check("Shared value", shared.produce(doubledRoot, context), std::ldexp(0.3, 40));
+
+    // a root added after phi reads only its own variable, not the nodes of phi below it
+    struct CountingContext : public math::CalculationContext {
+        CountingContext() : math::CalculationContext(0.3) {}
+
+        double value(math::TokenType, int) const override
+        {
+            _reads++;
+            return _parameterV;
+        }
+
+        mutable size_t _reads = 0;
+    } counting;
+
+    math::Equation late;
+    late.parse("xi*3.5");
+    const auto lateRoot = flat.fromOperator(late._sintaxis_tree_root);
+
+    failures += check("Late root value", flat.produce(lateRoot, counting), 0.3 * 3.5);
+    if(counting._reads != 1)
+    {
+        failures++;
+        std::cerr << "Late root of " << flat.size() << " nodes reads " << counting._reads << " variables instead of 1" << std::endl;
+    }
+
+    flat.clear();
+
+    return failures;
+}
+
+int recurrence_test()
+{
+    auto failures = 0;
+    const auto iterations = 3;
+
+    math::VariablesContext context;
+    for(auto k = 0; k <= iterations; k++)
+    {
+        context.set(math::TokenType::var_xi, k, 0.3 + 0.1 * k);
+        context.set(math::TokenType::var_mi, k, 0.2 - 0.05 * k);
+        context.set(math::TokenType::var_di, k, 0.9 + 0.2 * k);
+    }
+
+    math::Equation phi0;
+    phi0.parse(g_Phi0Script);
+
+    auto phi = phi0._sintaxis_tree_root;
+    for(auto i = 0; i < iterations; i++)
+    {
+        math::Equation eqNextStep(phi, true);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    math::Recurrence recurrence(g_Phi0Script, g_PhiStepScript, iterations);
+    failures += check("Recurrence phi", recurrence.produce(context), phi->produce(context));
+
+    for(auto t : {math::TokenType::var_mi, math::TokenType::var_di})
+    {
+        const auto gradient = recurrence.gradient(t, context);
+        for(auto k = 0; k <= iterations; k++)
+        {
+            auto dv = phi->derevative(t, k);
+            failures += check("Recurrence gradient by " + math::g_LiteralTokens.at(t) + "(i-" + std::to_string(k) + ")",
+                              gradient[k], dv ? dv->produce(context) : 0.);
+        }
+    }
+
+    return failures;
+}
+
+int intrinsics_test()
+{
+    auto failures = 0;
+
+    math::Equation eq;
+    eq.parse("log(xi)+sqrt(xi)*tanh(mi)-sigmoid(di*xi)+sin(xi)*cos(mi)");
+
+    std::cout << "Equation: " << eq._sintaxis_tree_root->toString() << std::endl;
+    auto dv = eq._sintaxis_tree_root->derevative(math::TokenType::var_xi);
+    std::cout << "Has derevative: " << (dv ? dv->toString() : "zero") << std::endl;
+
+    std::vector<math::VariablesContext> points;
+    for(auto p = 0; p < 1000; p++)
+    {
+        math::VariablesContext point;
+        point.set(math::TokenType::var_xi, 0, 0.5 + p * 0.01);
+        point.set(math::TokenType::var_mi, 0, 0.1 * p);
+        point.set(math::TokenType::var_di, 0, 1.5);
+        points.push_back(point);
+    }
+
+    math::FlatExpression flat;
+    const auto root = flat.fromOperator(dv);
+    const auto batch = flat.produce(root, points);
+
+    double maxError = 0.;
+    for(auto p = 0u; p < points.size(); p++)
+        maxError = std::max(maxError, relativeError(batch[p], dv->produce(points[p])));
+
+    failures += check("Batch evaluation of " + std::to_string(points.size()) + " points, max error", maxError, 0.);
+
+    // a deep graph, whose columns are reused once their last reader is done
+    math::Equation phi0;
+    phi0.parse(g_Phi0Script);
+
+    auto phi = phi0._sintaxis_tree_root;
+    for(auto i = 0; i < 5; i++)
+    {
+        math::Equation eqNextStep(phi, true);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    auto phiDv = phi->derevative(math::TokenType::var_xi, 3);
+    const auto phiRoot = flat.fromOperator(phiDv);
+    const auto phiBatch = flat.produce(phiRoot, points);
+
+    double phiError = 0.;
+    for(auto p = 0u; p < points.size(); p++)
+        phiError = std::max(phiError, relativeError(phiBatch[p], phiDv->produce(points[p])));
+
+    failures += check("Batch evaluation of " + std::to_string(phiRoot + 1) + " nodes, max error", phiError, 0.);
+
+    // derevatives of every function against central differences, through the chain rule of u = 0.5 + xi^2
+    auto &registry = math::IntrinsicRegistry::instance();
+    if(!registry.find("expm1"))
+        registry.add({ "expm1", [](math::OperatorPtr u){
+                           return std::make_shared<math::UnaryOperator>(math::TokenType::exp, u);
+                       }, [](double v){ return std::expm1(v); },
+                       [](const double *in, double *out, size_t n){
+                           for(size_t i = 0; i < n; i++)
+                               out[i] = std::expm1(in[i]);
+                       } });
+
+    for(auto i = 0u; i < registry.size(); i++)
+    {
+        const auto &intrinsic = registry.at(i);
+
+        math::Equation call;
+        call.parse(intrinsic._name + "(0.5+xi^2)");
+
+        const auto op = call._sintaxis_tree_root;
+        const auto derevative = op->derevative(math::TokenType::var_xi);
+
+        for(auto x : {-0.7, 0.3, 1.1})
+            failures += check("Derevative of " + op->toString() + " against differences",
+                              derevative->produce(math::VariablesContext(x)),
+                              difference(op, math::TokenType::var_xi, math::VariablesContext(x)), 1e-6);
+    }
+
+    return failures;
+}
+
+int lazy_derevatives_test()
+{
+    auto failures = 0;
+
+    math::Equation eq;
+    eq.parse(g_Phi0Script);
+
+    auto phi = eq._sintaxis_tree_root;
+    for(auto i = 0; i < 4; i++)
+    {
+        math::Equation eqNextStep(phi, true);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    math::VariablesContext context(0.4);
+    context.set(math::TokenType::var_mi, 2, 0.1);
+    context.set(math::TokenType::var_di, 2, 1.3);
+
+    for(auto deep = 0; deep <= 4; deep++)
+    {
+        auto eager = phi->derevative(math::TokenType::var_di, deep);
+        auto lazy = math::lazyDerevative(phi, math::TokenType::var_di, deep);
+
+        const auto name = "Lazy derevative by d(i-" + std::to_string(deep) + ")";
+        failures += check(name, lazy ? lazy->produce(context) : 0., eager ? eager->produce(context) : 0.);
+
+        const auto lazyText = lazy ? lazy->toString() : "zero";
+        const auto eagerText = eager ? eager->toString() : "zero";
+        if(lazyText != eagerText)
+        {
+            failures++;
+            std::cerr << name << " is " << lazyText << " instead of " << eagerText << std::endl;
+        }
+    }
+
+    // derevatives of lazy derevatives, a lazy node of a lazy node used to expand to itself forever
+    math::Equation cube;
+    cube.parse("xi^3*mi");
+
+    const math::VariablesContext at(0.7);
+    auto second = math::lazyDerevative(cube._sintaxis_tree_root, math::TokenType::var_xi)->derevative(math::TokenType::var_xi);
+    failures += check("Second lazy derevative of xi^3*mi", second ? second->produce(at) : 0., 6 * 0.7 * 0.7);
+
+    auto third = second ? second->derevative(math::TokenType::var_xi) : nullptr;
+    failures += check("Third lazy derevative of xi^3*mi", third ? third->produce(at) : 0., 6 * 0.7);
+
+    auto mixed = math::lazyDerevative(phi, math::TokenType::var_di, 1)->derevative(math::TokenType::var_mi, 2);
+    auto eagerMixed = phi->derevative(math::TokenType::var_di, 1)->derevative(math::TokenType::var_mi, 2);
+    failures += check("Lazy derevative by d(i-1) and m(i-2)", mixed ? mixed->produce(context) : 0.,
+                      eagerMixed ? eagerMixed->produce(context) : 0.);
+
+    return failures;
+}
+
+int parallel_evaluation_test()
+{
+    auto failures = 0;
+
+    math::Equation eq;
+    eq.parse(g_Phi0Script);
+
+    auto phi = eq._sintaxis_tree_root;
+    for(auto i = 0; i < 5; i++)
+    {
+        math::Equation eqNextStep(phi, true);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    auto dv = phi->derevative(math::TokenType::var_mi, 2);
+
+    math::FlatExpression flat;
+    const auto root = flat.fromOperator(dv);
+
+    math::ParallelEvaluator evaluator(flat, root, 4);
+    evaluator._chunkSize = 8;
+
+    const math::CalculationContext context(0.6);
+    failures += check("Parallel evaluation of " + std::to_string(evaluator.nodesCount()) + " nodes in "
+                      + std::to_string(evaluator.levelsCount()) + " levels", evaluator.produce(context), dv->produce(context));
+
+    // phi and its derevatives in one sweep, the nodes they share are evaluated once
+    std::vector<math::OperatorPtr> operators = {phi};
+    for(auto k = 0; k <= 5; k++)
+        operators.push_back(phi->derevative(math::TokenType::var_mi, k));
+
+    std::vector<math::FlatExpression::Index> roots;
+    size_t separateNodes = 0;
+    for(const auto &op : operators)
+    {
+        roots.push_back(flat.fromOperator(op));
+        separateNodes += math::ParallelEvaluator(flat, roots.back(), 1).nodesCount();
+    }
+
+    math::ParallelEvaluator shared(flat, roots, 4);
+    shared._chunkSize = 8;
+    shared.produce(context);
+
+    for(auto k = 0u; k < roots.size(); k++)
+        failures += check("Shared parallel evaluation of root " + std::to_string(k), shared.value(k), operators[k]->produce(context));
+
+    if(shared.nodesCount() >= separateNodes)
+    {
+        failures++;
+        std::cerr << "Shared parallel evaluation of " << shared.nodesCount() << " nodes, not fewer than "
+                  << separateNodes << " of the separate ones" << std::endl;
+    }
+
+    return failures;
+}
+
+// phi of four steps with every di and the older mi frozen, xi and mi of this step are free,
+// and points which agree with the frozen values
+struct SpecializationCase {
+    SpecializationCase()
+    {
+        const auto iterations = 4;
+
+        math::Equation eq;
+        eq.parse(g_Phi0Script);
+
+        _phi = eq._sintaxis_tree_root;
+        for(auto i = 0; i < iterations; i++)
+        {
+            math::Equation eqNextStep(_phi, true);
+            eqNextStep.parse(g_PhiStepScript);
+            _phi = eqNextStep._sintaxis_tree_root;
+        }
+
+        for(auto k = 0; k <= iterations; k++)
+        {
+            _bindings[{math::TokenType::var_di, k}] = 0.8 + 0.1 * k;
+            if(k)
+                _bindings[{math::TokenType::var_mi, k}] = 0.3 - 0.05 * k;
+        }
+
+        _residual = math::specialize(_phi, _bindings);
+
+        for(auto p = 0; p < 1000; p++)
+        {
+            math::VariablesContext point;
+            for(const auto &[variable, value] : _bindings)
+                point.set(variable.first, variable.second, value);
+
+            for(auto k = 0; k <= iterations; k++)
+                point.set(math::TokenType::var_xi, k, 0.01 * p - 0.1 * k);
+
+            point.set(math::TokenType::var_mi, 0, 0.5 - 0.001 * p);
+            _points.push_back(point);
+        }
+    }
+
+    math::OperatorPtr _phi;
+    math::Bindings _bindings;
+    math::OperatorPtr _residual;
+    std::vector<math::VariablesContext> _points;
+};
+
+int specialization_test()
+{
+    auto failures = 0;
+
+    const SpecializationCase specialization;
+    const auto &phi = specialization._phi;
+    const auto &residual = specialization._residual;
+    const auto &points = specialization._points;
+
+    math::FlatExpression flat, residualFlat;
+    flat.fromOperator(phi);
+    residualFlat.fromOperator(residual);
+
+    if(flat.size() != 107 || residualFlat.size() != 91)
+    {
+        failures++;
+        std::cerr << "Specialized on " << specialization._bindings.size() << " variables: " << flat.size() << " nodes to "
+                  << residualFlat.size() << " instead of 107 to 91" << std::endl;
+    }
+
+    double maxError = 0.;
+    for(const auto &point : points)
+        maxError = std::max(maxError, relativeError(residual->produce(point), phi->produce(point)));
+
+    failures += check("Specialized phi, max error", maxError, 0.);
+
+    for(auto k : {0, 2})
+    {
+        auto dv = phi->derevative(math::TokenType::var_xi, k);
+        auto specializedDv = residual->derevative(math::TokenType::var_xi, k);
+
+        double dvError = 0.;
+        for(const auto &point : points)
+            dvError = std::max(dvError, relativeError(specializedDv->produce(point), dv->produce(point)));
+
+        failures += check("Specialized derevative by x(i-" + std::to_string(k) + "), max error", dvError, 0.);
+    }
+
+    auto dvByMi = residual->derevative(math::TokenType::var_mi, 0);
+    failures += check("Specialized derevative by mi", dvByMi->produce(points[10]),
+                      phi->derevative(math::TokenType::var_mi, 0)->produce(points[10]));
+
+    if(auto dvByBound = residual->derevative(math::TokenType::var_di, 1))
+    {
+        failures++;
+        std::cerr << "Specialized derevative by bound d(i-1) is " << dvByBound->toString() << " instead of zero" << std::endl;
+    }
+
+    return failures;
+}
+
+int equations_tests()
+{
+    const auto failures = equations_test() + flat_expressions_test() + recurrence_test() + intrinsics_test()
+                          + lazy_derevatives_test() + parallel_evaluation_test() + specialization_test();
+
+    std::cout << (failures ? "Equation tests failed: " + std::to_string(failures) : "Equation tests passed") << std::endl;
+    return failures ? 1 : 0;
+}
+
+// times of the specialized expression against the whole one, which depend on the machine
+void specialization_benchmark(int repeat)
+{
+    const SpecializationCase specialization;
+
+    auto timeOf = [&specialization, repeat](const math::OperatorPtr &op){
+        double sum = 0.;
+        const auto start = std::chrono::steady_clock::now();
+        for(auto r = 0; r < repeat; r++)
+            for(const auto &point : specialization._points)
+                sum += op->produce(point);
+
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+        return std::make_pair(seconds.count(), sum);
+    };
+
+    const auto phi = timeOf(specialization._phi);
+    const auto residual = timeOf(specialization._residual);
+
+    std::cout << "Phi: " << phi.first << " s, specialized on " << specialization._bindings.size() << " variables: "
+              << residual.first << " s, " << phi.first / residual.first << " times faster" << std::endl;
+}
+
+void evaluate_graph(int iterations, math::TokenType derBy, bool sharedParameters, const Options &options)
+{
+    const auto &point = options._evaluateAt;
+
+    math::Equation phi0;
+    phi0.parse(g_Phi0Script);
+
+    auto phi = phi0._sintaxis_tree_root;
+    for(auto i = 0; i < iterations; i++)
+    {
+        math::Equation eqNextStep(phi, !sharedParameters);
+        eqNextStep.parse(g_PhiStepScript);
+        phi = eqNextStep._sintaxis_tree_root;
+    }
+
+    math::VariablesContext context;
+    for(auto k = 0; k <= iterations; k++)
+    {
+        context.set(math::TokenType::var_xi, k, point[0]);
+        context.set(math::TokenType::var_mi, k, point[1]);
+        context.set(math::TokenType::var_di, k, point[2]);
+    }
+
+    math::FlatExpression flat;
+    std::vector<std::pair<std::string, math::FlatExpression::Index>> roots = {{"Phii", flat.fromOperator(prepare(options, phi))}};
+
+    for(auto k = 0; k <= (sharedParameters ? 0 : iterations); k++)
+    {
+        std::string parameter = math::g_LiteralTokens.at(derBy);
+        if(k)
+            parameter = parameter.substr(0, 1) + "(i-" + std::to_string(k) + ")";
+
+        auto dv = prepare(options, math::lazyDerevative(phi, derBy, k));
+        roots.emplace_back("dPhii/d" + parameter, dv ? flat.fromOperator(dv) : flat.fromOperator(std::make_shared<math::ConstantOperator>(0.)));
+    }
+
+    // one sweep over the shared graph for all of them
+    std::vector<math::FlatExpression::Index> indexes;
+    for(const auto &root : roots)
+        indexes.push_back(root.second);
+
+    math::ParallelEvaluator evaluator(flat, indexes, options._threads);
+    evaluator.produce(context);
+
+    for(auto k = 0u; k < roots.size(); k++)
+        cout << roots[k].first << " = " << evaluator.value(k) << std::endl;
+}
+
+void evaluate_recurrence(int iterations, math::TokenType derBy, bool sharedParameters, const Options &options)
+{
+    const auto &point = options._evaluateAt;
+
+    math::Recurrence::Simplify simplify;
+    if(options._optimize)
+        simplify = [&options](const math::OperatorPtr &op){ return prepare(options, op); };
+
+    math::Recurrence recurrence(g_Phi0Script, g_PhiStepScript, iterations, sharedParameters, simplify);
+
+    math::VariablesContext context;
+    for(auto k = 0; k <= (sharedParameters ? 0 : iterations); k++)
+    {
+        context.set(math::TokenType::var_xi, k, point[0]);
+        context.set(math::TokenType::var_mi, k, point[1]);
+        context.set(math::TokenType::var_di, k, point[2]);
+    }
+
+    cout << "Phii = " << recurrence.produce(context) << std::endl;
+
+    const auto gradient = recurrence.gradient(derBy, context);
+    for(auto k = 0u; k < gradient.size(); k++)
+    {
+        std::string parameter = math::g_LiteralTokens.at(derBy);
+        if(k)
+            parameter = parameter.substr(0, 1) + "(i-" + std::to_string(k) + ")";
+
+        cout << "dPhii/d" << parameter << " = " << gradient[k] << std::endl;
+    }
+}
+
 int main(int argc, char* argv[])
 {
     if(argc < 2 || !argv)
@@ -68,8 +754,13 @@ int main(int argc, char* argv[])
 
     if(std::string(argv[1]) == "test")
     {
-        equations_test();
         iterable_equations_test();
+        return equations_tests();
+    }
+
+    if(std::string(argv[1]) == "bench")
+    {
+        specialization_benchmark(argc > 2 ? std::stoi(argv[2]) : 20);
         return 0;
     }
 
@@ -82,6 +773,7 @@ int main(int argc, char* argv[])
     const auto numberOfIterations = std::stoi(argv[1]);
     const std::string byParameter = argv[2];
     const bool parameters_are_same_for_all_iterations = std::stoi(argv[3]);
+    const auto options = parseOptions(argc, argv, 4);
 
     cout << "Program will calculate gradients by " << (byParameter == "d" ? "standard deviations" : "centres") << " parameter, and "
          << numberOfIterations << " iterations, also derevative parameters are "
@@ -92,8 +784,20 @@ int main(int argc, char* argv[])
     if(byParameter == "d")
         derBy = math::TokenType::var_di;
 
+    if(!options._evaluateAt.empty() && options._evaluateGraph)
+    {
+        evaluate_graph(numberOfIterations, derBy, parameters_are_same_for_all_iterations, options);
+        return 0;
+    }
+
+    if(!options._evaluateAt.empty())
+    {
+        evaluate_recurrence(numberOfIterations, derBy, parameters_are_same_for_all_iterations, options);
+        return 0;
+    }
+
     math::Equation phi0;
-    phi0.parse("exp((-(xi-mi)^2)/(2*di^2))");
+    phi0.parse(g_Phi0Script);
 
     auto phi_previous = phi0._sintaxis_tree_root;
 
@@ -105,11 +809,11 @@ int main(int argc, char* argv[])
         {
             cout << "!!!! Iteration " << i << " !!!!" << std::endl;
             math::Equation eqNextStep(phi_previous, false);
-            eqNextStep.parse("exp((-(xi-mi)^2)/(2*di^2))+exp((-(phi(i-1)-mi)^2)/(2*di^2))");
+            eqNextStep.parse(g_PhiStepScript);
 
-            std::cout << "Equation: " << eqNextStep._sintaxis_tree_root->toString() << std::endl;
+            std::cout << "Equation: " << present(options, eqNextStep._sintaxis_tree_root) << std::endl;
             auto dv = eqNextStep._sintaxis_tree_root->derevative(derBy);
-            std::cout << "Has gradient by selected parameter: " << (dv ? dv->toString() : "zero") << std::endl;
+            std::cout << "Has gradient by selected parameter: " << present(options, dv) << std::endl;
 
             phi_previous = eqNextStep._sintaxis_tree_root;
         }
@@ -119,14 +823,14 @@ int main(int argc, char* argv[])
         for(auto i = 0; i < numberOfIterations; i++)
         {
             math::Equation eqNextStep(phi_previous, true);
-            eqNextStep.parse("exp((-(xi-mi)^2)/(2*di^2))+exp((-(phi(i-1)-mi)^2)/(2*di^2))");
+            eqNextStep.parse(g_PhiStepScript);
             phi_previous = eqNextStep._sintaxis_tree_root;
         }
 
         math::Equation finalEquation;
         finalEquation._sintaxis_tree_root = phi_previous;
 
-        cout << "Equation : Phii = " << finalEquation._sintaxis_tree_root->toString() << std::endl;
+        cout << "Equation : Phii = " << present(options, finalEquation._sintaxis_tree_root) << std::endl;
         cout << "Has next derivatives: " << std::endl;
 
         for(auto i = 0; i <= numberOfIterations; i++)
@@ -142,7 +846,7 @@ int main(int argc, char* argv[])
             cout << "By parameter: " << parameter << ": dPhii/d" << parameter << " = "<< std::endl;
 
             auto dv = finalEquation._sintaxis_tree_root->derevative(derBy, i);
-            std::cout << (dv ? dv->toString() : "zero") << std::endl;
+            std::cout << present(options, dv) << std::endl;
         }
     }
 
@@ -0,0 +1,301 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MatrixFile.h"
+
+namespace math {
+
+// Determinants of many matrices. A reader thread loads matrices ahead into a bounded queue,
+// so I/O overlaps computation; the calling thread hands them to the task pool as tasks and
+// every result line is written as soon as all lines before it are written.
+// Input is a directory (every file is a matrix), a wildcard pattern in the last path component,
+// or a single file of text matrices separated by blank lines or of concatenated binary matrices.
+class Batch {
+public:
+    using Evaluate = std::function<std::string(const Matrix &, const IntegerMatrix &, const SparseMatrix &)>;
+
+    explicit Batch(const std::string &input)
+    {
+        namespace fs = std::filesystem;
+
+        const fs::path path(input);
+        const auto pattern = path.filename().string();
+
+        if(fs::is_directory(path))
+        {
+            for(const auto &entry : fs::directory_iterator(path))
+                if(entry.is_regular_file())
+                    _sources.push_back({entry.path().string(), false});
+        }
+        else if(pattern.find_first_of("*?") != std::string::npos)
+        {
+            const auto directory = path.has_parent_path() ? path.parent_path() : fs::path(".");
+            for(const auto &entry : fs::directory_iterator(directory))
+                if(entry.is_regular_file() && matches(pattern, entry.path().filename().string()))
+                    _sources.push_back({entry.path().string(), false});
+        }
+        else if(fs::is_regular_file(path))
+            _sources.push_back({input, true});
+        else
+            throw std::runtime_error("No such batch input: " + input);
+
+        std::sort(_sources.begin(), _sources.end(), [](const Source &a, const Source &b){ return a._path < b._path; });
+    }
+
+    // lines "<name>: <result>" in input order, returns the number of matrices
+    size_t run(TaskPool &pool, const Evaluate &evaluate, std::ostream &out)
+    {
+        const auto capacity = 2 * pool.size();
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::shared_ptr<Job>> loaded;
+        bool isLoaded = false;
+
+        std::thread reader([&](){
+            TaskPool parser(1);
+            size_t index = 0;
+
+            auto push = [&](std::shared_ptr<Job> job){
+                job->_index = index++;
+
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&](){ return loaded.size() < capacity; });
+                loaded.push_back(std::move(job));
+                changed.notify_all();
+            };
+
+            for(const auto &source : _sources)
+            {
+                try {
+                    load(source, parser, push);
+                }
+                catch(std::exception &ex)
+                {
+                    auto job = std::make_shared<Job>();
+                    job->_name = source._path;
+                    job->_error = ex.what();
+                    push(std::move(job));
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            isLoaded = true;
+            changed.notify_all();
+        });
+
+        std::mutex outMutex;
+        std::map<size_t, std::string> finished;
+        size_t written = 0;
+
+        auto complete = [&](size_t index, std::string line){
+            std::lock_guard<std::mutex> lock(outMutex);
+            finished.emplace(index, std::move(line));
+
+            for(auto it = finished.begin(); it != finished.end() && it->first == written; it = finished.erase(it))
+            {
+                out << it->second << std::endl;
+                written++;
+            }
+        };
+
+        TaskGroup group;
+        size_t count = 0;
+
+        for(;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&](){ return !loaded.empty() || isLoaded; });
+
+                if(loaded.empty())
+                    break;
+
+                job = std::move(loaded.front());
+                loaded.pop_front();
+                changed.notify_all();
+            }
+
+            pool.spawn(group, [job, &evaluate, &complete](){
+                std::string result;
+                if(job->_error.empty())
+                {
+                    try {
+                        result = evaluate(job->_matrix, job->_integers, job->_sparse);
+                    }
+                    catch(std::exception &ex)
+                    {
+                        result = std::string("error: ") + ex.what();
+                    }
+                }
+                else
+                    result = "error: " + job->_error;
+
+                complete(job->_index, job->_name + ": " + result);
+            });
+
+            // the calling thread computes too, and matrices in flight stay bounded
+            if(++count % capacity == 0)
+                pool.wait(group);
+        }
+
+        pool.wait(group);
+        reader.join();
+
+        return count;
+    }
+
+    size_t sourcesCount() const { return _sources.size(); }
+
+    // '*' matches any run of characters and '?' any one character
+    static bool matches(const std::string &pattern, const std::string &name)
+    {
+        size_t p = 0, n = 0;
+        size_t star = std::string::npos, starName = 0;
+
+        while(n < name.size())
+        {
+            if(p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+            {
+                p++;
+                n++;
+            }
+            else if(p < pattern.size() && pattern[p] == '*')
+            {
+                star = p++;
+                starName = n;
+            }
+            else if(star != std::string::npos)
+            {
+                p = star + 1;
+                n = ++starName;
+            }
+            else
+                return false;
+        }
+
+        while(p < pattern.size() && pattern[p] == '*')
+            p++;
+
+        return p == pattern.size();
+    }
+
+private:
+    struct Source {
+        std::string _path;
+        bool _isMultiple;
+    };
+
+    struct Job {
+        size_t _index = 0;
+        std::string _name;
+        Matrix _matrix;
+        IntegerMatrix _integers;
+        SparseMatrix _sparse;
+        std::string _error;
+    };
+
+    template<class Push>
+    static void load(const Source &source, TaskPool &parser, Push &push)
+    {
+        if(!source._isMultiple)
+        {
+            auto job = std::make_shared<Job>();
+            job->_name = source._path;
+            job->_matrix = readMatrixFile(source._path, parser, &job->_integers, &job->_sparse);
+            push(std::move(job));
+            return;
+        }
+
+        MappedFile file(source._path);
+        if(!file.size())
+            return;
+
+        const auto begin = file.data();
+        const auto end = begin + file.size();
+        size_t number = 0;
+
+        auto nextJob = [&](){
+            auto job = std::make_shared<Job>();
+            job->_name = source._path + "#" + std::to_string(++number);
+            return job;
+        };
+
+        if(isBinaryMatrix(begin, file.size()))
+        {
+            for(auto p = begin; p < end;)
+            {
+                BinaryMatrixHeader header;
+                if(static_cast<size_t>(end - p) < sizeof(header))
+                    throw std::runtime_error("Wrong binary matrix header");
+
+                std::memcpy(&header, p, sizeof(header));
+                const auto size = sizeof(header) + header._rows * header._cols * sizeof(double);
+                if(size > static_cast<size_t>(end - p))
+                    throw std::runtime_error("Wrong binary matrix size");
+
+                auto job = nextJob();
+                job->_matrix = parseMatrixBinary(p, size);
+                job->_matrix.toIntegers(job->_integers);
+                push(std::move(job));
+
+                p += size;
+            }
+
+            return;
+        }
+
+        // text matrices end at blank lines
+        auto isBlank = [](const char *first, const char *last){
+            return std::all_of(first, last, [](char c){ return c == ' ' || c == '\t' || c == '\r'; });
+        };
+
+        const char *matrixBegin = nullptr;
+        for(auto p = begin;;)
+        {
+            const auto lineEnd = std::find(p, end, '\n');
+            const auto blank = isBlank(p, lineEnd);
+
+            if(!blank && !matrixBegin)
+                matrixBegin = p;
+
+            if(matrixBegin && (blank || lineEnd == end))
+            {
+                // a broken matrix doesn't stop the ones after it
+                auto job = nextJob();
+                try {
+                    job->_matrix = parseMatrixText(matrixBegin, blank ? p : lineEnd, parser, &job->_integers, &job->_sparse);
+                }
+                catch(std::exception &ex)
+                {
+                    job->_error = ex.what();
+                }
+
+                push(std::move(job));
+                matrixBegin = nullptr;
+            }
+
+            if(lineEnd == end)
+                break;
+
+            p = lineEnd + 1;
+        }
+    }
+
+    std::vector<Source> _sources;
+};
+
+}
@@ -0,0 +1,362 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace math {
+
+// arbitrary-precision signed integer: sign and magnitude in 32-bit limbs, lowest limb first
+class BigInteger {
+public:
+    BigInteger() = default;
+
+    BigInteger(long long v)
+        : BigInteger(static_cast<__int128>(v)) {}
+
+    BigInteger(__int128 v)
+    {
+        _negative = v < 0;
+        unsigned __int128 magnitude = _negative ? -static_cast<unsigned __int128>(v) : static_cast<unsigned __int128>(v);
+
+        while(magnitude)
+        {
+            _limbs.push_back(static_cast<uint32_t>(magnitude));
+            magnitude >>= 32;
+        }
+    }
+
+    static BigInteger fromUnsigned(uint64_t v)
+    {
+        return BigInteger(static_cast<__int128>(v));
+    }
+
+    bool isZero() const { return _limbs.empty(); }
+    bool isNegative() const { return _negative; }
+    size_t bits() const
+    {
+        if(_limbs.empty())
+            return 0;
+
+        return 32 * (_limbs.size() - 1) + (32 - __builtin_clz(_limbs.back()));
+    }
+
+    BigInteger operator-() const
+    {
+        BigInteger res = *this;
+        if(!res.isZero())
+            res._negative = !res._negative;
+
+        return res;
+    }
+
+    friend BigInteger operator+(const BigInteger &a, const BigInteger &b)
+    {
+        if(a._negative == b._negative)
+            return BigInteger(addMagnitude(a._limbs, b._limbs), a._negative);
+
+        if(compareMagnitude(a._limbs, b._limbs) >= 0)
+            return BigInteger(subMagnitude(a._limbs, b._limbs), a._negative);
+
+        return BigInteger(subMagnitude(b._limbs, a._limbs), b._negative);
+    }
+
+    friend BigInteger operator-(const BigInteger &a, const BigInteger &b)
+    {
+        return a + (-b);
+    }
+
+    friend BigInteger operator*(const BigInteger &a, const BigInteger &b)
+    {
+        return BigInteger(mulMagnitude(a._limbs, b._limbs), a._negative != b._negative);
+    }
+
+    // truncating division like for built-in integers
+    friend BigInteger operator/(const BigInteger &a, const BigInteger &b)
+    {
+        std::vector<uint32_t> quotient;
+        std::vector<uint32_t> remainder;
+        divModMagnitude(a._limbs, b._limbs, quotient, remainder);
+
+        return BigInteger(std::move(quotient), a._negative != b._negative);
+    }
+
+    friend BigInteger operator%(const BigInteger &a, const BigInteger &b)
+    {
+        std::vector<uint32_t> quotient;
+        std::vector<uint32_t> remainder;
+        divModMagnitude(a._limbs, b._limbs, quotient, remainder);
+
+        return BigInteger(std::move(remainder), a._negative);
+    }
+
+    friend bool operator==(const BigInteger &a, const BigInteger &b)
+    {
+        return a._negative == b._negative && a._limbs == b._limbs;
+    }
+
+    friend bool operator!=(const BigInteger &a, const BigInteger &b)
+    {
+        return !(a == b);
+    }
+
+    friend bool operator<(const BigInteger &a, const BigInteger &b)
+    {
+        if(a._negative != b._negative)
+            return a._negative;
+
+        const auto cmp = compareMagnitude(a._limbs, b._limbs);
+        return a._negative ? cmp > 0 : cmp < 0;
+    }
+
+    // non-negative remainder of division by m
+    uint64_t mod(uint64_t m) const
+    {
+        if(!m)
+            throw std::runtime_error("Division by zero");
+
+        unsigned __int128 rest = 0;
+        for(auto it = _limbs.rbegin(); it != _limbs.rend(); it++)
+            rest = ((rest << 32) | *it) % m;
+
+        const auto res = static_cast<uint64_t>(rest);
+        return _negative && res ? m - res : res;
+    }
+
+    double toDouble() const
+    {
+        double res = 0.;
+        for(auto it = _limbs.rbegin(); it != _limbs.rend(); it++)
+            res = res * 4294967296. + *it;
+
+        return _negative ? -res : res;
+    }
+
+    std::string toString() const
+    {
+        if(isZero())
+            return "0";
+
+        std::vector<uint32_t> magnitude = _limbs;
+        std::string res;
+
+        // peel off 9 decimal digits at a time
+        while(!magnitude.empty())
+        {
+            const auto rest = divSmall(magnitude, 1000000000u);
+
+            auto digits = std::to_string(rest);
+            if(!magnitude.empty())
+                digits.insert(0, 9 - digits.size(), '0');
+
+            res.insert(0, digits);
+        }
+
+        if(_negative)
+            res.insert(0, "-");
+
+        return res;
+    }
+
+private:
+    BigInteger(std::vector<uint32_t> &&limbs, bool negative)
+        : _negative(negative), _limbs(std::move(limbs))
+    {
+        trim(_limbs);
+        if(_limbs.empty())
+            _negative = false;
+    }
+
+    static void trim(std::vector<uint32_t> &limbs)
+    {
+        while(!limbs.empty() && !limbs.back())
+            limbs.pop_back();
+    }
+
+    static int compareMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        if(a.size() != b.size())
+            return a.size() < b.size() ? -1 : 1;
+
+        for(auto i = a.size(); i-- > 0;)
+            if(a[i] != b[i])
+                return a[i] < b[i] ? -1 : 1;
+
+        return 0;
+    }
+
+    static std::vector<uint32_t> addMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        std::vector<uint32_t> res(std::max(a.size(), b.size()) + 1, 0);
+        uint64_t carry = 0;
+
+        for(auto i = 0u; i < res.size(); i++)
+        {
+            uint64_t sum = carry;
+            if(i < a.size())
+                sum += a[i];
+            if(i < b.size())
+                sum += b[i];
+
+            res[i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+
+        return res;
+    }
+
+    // a >= b
+    static std::vector<uint32_t> subMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        std::vector<uint32_t> res(a.size(), 0);
+        int64_t borrow = 0;
+
+        for(auto i = 0u; i < a.size(); i++)
+        {
+            int64_t diff = static_cast<int64_t>(a[i]) - borrow - (i < b.size() ? b[i] : 0);
+            borrow = diff < 0 ? 1 : 0;
+            res[i] = static_cast<uint32_t>(diff + (borrow << 32));
+        }
+
+        return res;
+    }
+
+    static std::vector<uint32_t> mulMagnitude(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        if(a.empty() || b.empty())
+            return {};
+
+        std::vector<uint32_t> res(a.size() + b.size(), 0);
+
+        for(auto i = 0u; i < a.size(); i++)
+        {
+            uint64_t carry = 0;
+            for(auto j = 0u; j < b.size(); j++)
+            {
+                const uint64_t cur = static_cast<uint64_t>(a[i]) * b[j] + res[i + j] + carry;
+                res[i + j] = static_cast<uint32_t>(cur);
+                carry = cur >> 32;
+            }
+
+            res[i + b.size()] = static_cast<uint32_t>(carry);
+        }
+
+        return res;
+    }
+
+    // divides in place and returns the remainder
+    static uint32_t divSmall(std::vector<uint32_t> &a, uint32_t divisor)
+    {
+        uint64_t rest = 0;
+        for(auto i = a.size(); i-- > 0;)
+        {
+            const uint64_t cur = (rest << 32) | a[i];
+            a[i] = static_cast<uint32_t>(cur / divisor);
+            rest = cur % divisor;
+        }
+
+        trim(a);
+        return static_cast<uint32_t>(rest);
+    }
+
+    // schoolbook long division, Knuth's algorithm D
+    static void divModMagnitude(const std::vector<uint32_t> &u, const std::vector<uint32_t> &v,
+                                std::vector<uint32_t> &quotient, std::vector<uint32_t> &remainder)
+    {
+        if(v.empty())
+            throw std::runtime_error("Division by zero");
+
+        if(compareMagnitude(u, v) < 0)
+        {
+            quotient.clear();
+            remainder = u;
+            return;
+        }
+
+        if(v.size() == 1)
+        {
+            quotient = u;
+            const auto rest = divSmall(quotient, v[0]);
+            remainder = rest ? std::vector<uint32_t>{rest} : std::vector<uint32_t>{};
+            return;
+        }
+
+        const auto n = v.size();
+        const auto m = u.size() - n;
+        const int shift = __builtin_clz(v.back());
+
+        std::vector<uint32_t> vn(n);
+        std::vector<uint32_t> un(u.size() + 1);
+
+        for(auto i = n - 1; i > 0; i--)
+            vn[i] = (v[i] << shift) | (shift ? static_cast<uint32_t>(static_cast<uint64_t>(v[i - 1]) >> (32 - shift)) : 0);
+        vn[0] = v[0] << shift;
+
+        un[u.size()] = shift ? static_cast<uint32_t>(static_cast<uint64_t>(u.back()) >> (32 - shift)) : 0;
+        for(auto i = u.size() - 1; i > 0; i--)
+            un[i] = (u[i] << shift) | (shift ? static_cast<uint32_t>(static_cast<uint64_t>(u[i - 1]) >> (32 - shift)) : 0);
+        un[0] = u[0] << shift;
+
+        const uint64_t base = uint64_t(1) << 32;
+        quotient.assign(m + 1, 0);
+
+        for(auto j = m + 1; j-- > 0;)
+        {
+            const uint64_t top = (static_cast<uint64_t>(un[j + n]) << 32) | un[j + n - 1];
+            uint64_t qhat = top / vn[n - 1];
+            uint64_t rhat = top % vn[n - 1];
+
+            while(qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+            {
+                qhat--;
+                rhat += vn[n - 1];
+                if(rhat >= base)
+                    break;
+            }
+
+            int64_t borrow = 0;
+            uint64_t carry = 0;
+            for(auto i = 0u; i < n; i++)
+            {
+                const uint64_t product = qhat * vn[i] + carry;
+                carry = product >> 32;
+
+                const int64_t diff = static_cast<int64_t>(un[i + j]) - borrow - static_cast<int64_t>(product & 0xffffffffu);
+                un[i + j] = static_cast<uint32_t>(diff);
+                borrow = diff < 0 ? 1 : 0;
+            }
+
+            const int64_t diff = static_cast<int64_t>(un[j + n]) - borrow - static_cast<int64_t>(carry);
+            un[j + n] = static_cast<uint32_t>(diff);
+
+            if(diff < 0)
+            {
+                qhat--;
+                uint64_t sum = 0;
+                for(auto i = 0u; i < n; i++)
+                {
+                    sum += static_cast<uint64_t>(un[i + j]) + vn[i];
+                    un[i + j] = static_cast<uint32_t>(sum);
+                    sum >>= 32;
+                }
+
+                un[j + n] = static_cast<uint32_t>(un[j + n] + sum);
+            }
+
+            quotient[j] = static_cast<uint32_t>(qhat);
+        }
+
+        remainder.assign(n, 0);
+        for(auto i = 0u; i < n; i++)
+            remainder[i] = (un[i] >> shift) | (shift ? static_cast<uint32_t>(static_cast<uint64_t>(un[i + 1]) << (32 - shift)) : 0);
+
+        trim(quotient);
+        trim(remainder);
+    }
+
+    bool _negative = false;
+    std::vector<uint32_t> _limbs;
+};
+
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MATH_AVX2_KERNEL 1
+#endif
+
+#include "Profile.h"
+#include "TaskPool.h"
+
+namespace math {
+
+// Right-looking blocked LU with partial pivoting over a row-major n x n array.
+// Every step factorizes a panel of blockSize columns, solves the block row of U
+// and subtracts L21 * U12 from the trailing matrix. The last one is almost all
+// of the flops: it runs as independent tiles on the task pool, with an AVX2/FMA
+// register-blocked kernel when the processor has it.
+class BlockedLU {
+public:
+    static constexpr size_t s_BlockSize = 64;
+    static constexpr size_t s_TileRows = 64;
+    static constexpr size_t s_TileColumns = 256;
+
+    // the array is overwritten by the factors
+    static double determinant(std::vector<double> &a, size_t n, TaskPool &pool, size_t blockSize = s_BlockSize)
+    {
+        blockSize = std::max<size_t>(blockSize, 1);
+        const auto update = hasAvx2() ? updateTileAvx2 : updateTileScalar;
+
+        // det = mantissa * 2^exponent, so big matrices don't overflow on the way
+        double mantissa = 1.;
+        int exponent = 0;
+
+        for(size_t k0 = 0; k0 < n; k0 += blockSize)
+        {
+            const auto k1 = std::min(n, k0 + blockSize);
+
+            // panel: columns [k0, k1) of rows [k0, n), whole rows are swapped
+            for(auto k = k0; k < k1; k++)
+            {
+                auto pivot = k;
+                for(auto i = k + 1; i < n; i++)
+                    if(std::fabs(a[i * n + k]) > std::fabs(a[pivot * n + k]))
+                        pivot = i;
+
+                if(a[pivot * n + k] == 0.)
+                    return 0.;
+
+                MATH_PROFILE_COUNT(pivots, 1);
+
+                if(pivot != k)
+                {
+                    MATH_PROFILE_COUNT(rowSwaps, 1);
+                    std::swap_ranges(a.begin() + pivot * n, a.begin() + (pivot + 1) * n, a.begin() + k * n);
+                    mantissa = -mantissa;
+                }
+
+                const auto akk = a[k * n + k];
+
+                int e = 0;
+                mantissa = std::frexp(mantissa * akk, &e);
+                exponent += e;
+
+                for(auto i = k + 1; i < n; i++)
+                {
+                    const auto factor = a[i * n + k] /= akk;
+                    if(factor == 0.)
+                        continue;
+
+                    for(auto j = k + 1; j < k1; j++)
+                        a[i * n + j] -= factor * a[k * n + j];
+                }
+            }
+
+            if(k1 == n)
+                break;
+
+            TaskGroup group;
+            double *data = a.data();
+
+            // U12 = L11^-1 * A12 by column tiles
+            for(auto j0 = k1; j0 < n; j0 += s_TileColumns)
+            {
+                const auto j1 = std::min(n, j0 + s_TileColumns);
+                pool.spawn(group, [=](){
+                    for(auto k = k0; k < k1; k++)
+                        for(auto i = k + 1; i < k1; i++)
+                        {
+                            const auto factor = data[i * n + k];
+                            for(auto j = j0; j < j1; j++)
+                                data[i * n + j] -= factor * data[k * n + j];
+                        }
+                });
+            }
+
+            pool.wait(group);
+
+            // A22 -= L21 * U12
+            for(auto i0 = k1; i0 < n; i0 += s_TileRows)
+                for(auto j0 = k1; j0 < n; j0 += s_TileColumns)
+                {
+                    const auto rows = std::min(s_TileRows, n - i0);
+                    const auto cols = std::min(s_TileColumns, n - j0);
+                    pool.spawn(group, [=](){
+                        update(data + i0 * n + j0, data + i0 * n + k0, data + k0 * n + j0, n, rows, cols, k1 - k0);
+                    });
+                }
+
+            pool.wait(group);
+        }
+
+        return std::ldexp(mantissa, exponent);
+    }
+
+    static bool hasAvx2()
+    {
+#ifdef MATH_AVX2_KERNEL
+        static const bool res = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return res;
+#else
+        return false;
+#endif
+    }
+
+    // c -= l * u for a rows x cols tile c, rows x depth l and depth x cols u, all with the same stride
+    static void updateTileScalar(double *c, const double *l, const double *u, size_t stride,
+                                 size_t rows, size_t cols, size_t depth)
+    {
+        for(auto i = 0u; i < rows; i++)
+            for(auto p = 0u; p < depth; p++)
+            {
+                const auto lip = l[i * stride + p];
+                if(lip == 0.)
+                    continue;
+
+                for(auto j = 0u; j < cols; j++)
+                    c[i * stride + j] -= lip * u[p * stride + j];
+            }
+    }
+
+#ifdef MATH_AVX2_KERNEL
+    // 4 x 8 blocks of c stay in eight registers for the whole depth
+    __attribute__((target("avx2,fma")))
+    static void updateTileAvx2(double *c, const double *l, const double *u, size_t stride,
+                               size_t rows, size_t cols, size_t depth)
+    {
+        size_t i = 0;
+        for(; i + 4 <= rows; i += 4)
+        {
+            size_t j = 0;
+            for(; j + 8 <= cols; j += 8)
+            {
+                __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+                __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+                __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+                __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+
+                const double *l0 = l + i * stride;
+                for(auto p = 0u; p < depth; p++)
+                {
+                    const auto u0 = _mm256_loadu_pd(u + p * stride + j);
+                    const auto u1 = _mm256_loadu_pd(u + p * stride + j + 4);
+
+                    auto lp = _mm256_broadcast_sd(l0 + p);
+                    c00 = _mm256_fmadd_pd(lp, u0, c00);
+                    c01 = _mm256_fmadd_pd(lp, u1, c01);
+
+                    lp = _mm256_broadcast_sd(l0 + stride + p);
+                    c10 = _mm256_fmadd_pd(lp, u0, c10);
+                    c11 = _mm256_fmadd_pd(lp, u1, c11);
+
+                    lp = _mm256_broadcast_sd(l0 + 2 * stride + p);
+                    c20 = _mm256_fmadd_pd(lp, u0, c20);
+                    c21 = _mm256_fmadd_pd(lp, u1, c21);
+
+                    lp = _mm256_broadcast_sd(l0 + 3 * stride + p);
+                    c30 = _mm256_fmadd_pd(lp, u0, c30);
+                    c31 = _mm256_fmadd_pd(lp, u1, c31);
+                }
+
+                double *row = c + i * stride + j;
+                _mm256_storeu_pd(row, _mm256_sub_pd(_mm256_loadu_pd(row), c00));
+                _mm256_storeu_pd(row + 4, _mm256_sub_pd(_mm256_loadu_pd(row + 4), c01));
+                row += stride;
+                _mm256_storeu_pd(row, _mm256_sub_pd(_mm256_loadu_pd(row), c10));
+                _mm256_storeu_pd(row + 4, _mm256_sub_pd(_mm256_loadu_pd(row + 4), c11));
+                row += stride;
+                _mm256_storeu_pd(row, _mm256_sub_pd(_mm256_loadu_pd(row), c20));
+                _mm256_storeu_pd(row + 4, _mm256_sub_pd(_mm256_loadu_pd(row + 4), c21));
+                row += stride;
+                _mm256_storeu_pd(row, _mm256_sub_pd(_mm256_loadu_pd(row), c30));
+                _mm256_storeu_pd(row + 4, _mm256_sub_pd(_mm256_loadu_pd(row + 4), c31));
+            }
+
+            if(j < cols)
+                updateTileScalar(c + i * stride + j, l + i * stride, u + j, stride, 4, cols - j, depth);
+        }
+
+        if(i < rows)
+            updateTileScalar(c + i * stride, l + i * stride, u, stride, rows - i, cols, depth);
+    }
+#else
+    static void updateTileAvx2(double *c, const double *l, const double *u, size_t stride,
+                               size_t rows, size_t cols, size_t depth)
+    {
+        updateTileScalar(c, l, u, stride, rows, cols, depth);
+    }
+#endif
+};
+
+}
@@ -0,0 +1,286 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "IntegerMatrix.h"
+#include "Matrix.h"
+#include "SparseMatrix.h"
+
+namespace math {
+
+// Determinants by the contents of the matrix, so a matrix submitted again is not computed again.
+// The key is two independent hashes of the dimensions and elements, FNV-1a and a polynomial one,
+// with the dimensions and the algorithm and precision mode. Entries keep their whole key and
+// a hit compares it, so another matrix gives a wrong result only when both hashes collide.
+// Every entry is a file named by its key in the cache directory, the recently used ones are kept
+// in memory too. Hits touch the file, and when the directory grows past the capacity the least
+// recently used files are removed down to s_EvictTo of it.
+class DeterminantCache {
+public:
+    static constexpr size_t s_DefaultCapacity = size_t(64) << 20;
+    static constexpr size_t s_MemoryEntries = 1024;
+    static constexpr double s_EvictTo = 0.75;
+
+    struct Statistics {
+        size_t _hits = 0;
+        size_t _memoryHits = 0;
+        size_t _misses = 0;
+        size_t _evictions = 0;
+    };
+
+    explicit DeterminantCache(const std::string &directory, size_t capacity = s_DefaultCapacity,
+                              size_t memoryEntries = s_MemoryEntries)
+        : _directory(directory), _capacity(capacity), _memoryEntries(memoryEntries)
+    {
+        namespace fs = std::filesystem;
+
+        std::error_code error;
+        fs::create_directories(_directory, error);
+        if(!fs::is_directory(_directory))
+            throw std::runtime_error("Can't create the cache directory: " + directory);
+
+        for(const auto &entry : fs::directory_iterator(_directory))
+            if(isEntry(entry))
+                _diskSize += entry.file_size();
+    }
+
+    // both hashes of the bytes added so far, they can be added in pieces
+    struct Digest {
+        uint64_t _fnv = s_FnvOffset;
+        uint64_t _polynomial = 0;
+
+        void add(const void *data, size_t bytes)
+        {
+            const auto *p = static_cast<const unsigned char *>(data);
+            for(size_t i = 0; i < bytes; i++)
+            {
+                _fnv = (_fnv ^ p[i]) * s_FnvPrime;
+                _polynomial = (_polynomial + p[i] + 1) * s_PolynomialBase;
+            }
+        }
+    };
+
+    // "<hashes>-<rows>x<cols>-<mode>", the mode tells how the result was computed
+    static std::string key(const Matrix &matrix, const IntegerMatrix &integers, const SparseMatrix &sparse,
+                           const std::string &mode)
+    {
+        Digest digest;
+
+        if(!sparse.isEmpty())
+        {
+            digest.add(sparse._colPointers.data(), sparse._colPointers.size() * sizeof(size_t));
+            digest.add(sparse._rowIndexes.data(), sparse._rowIndexes.size() * sizeof(size_t));
+            digest.add(sparse._values.data(), sparse._values.size() * sizeof(double));
+        }
+        else
+            digest.add(matrix.data(), matrix._data.size() * sizeof(double));
+
+        // integers bigger than 2^53 are not told apart by their doubles
+        if(!integers.isEmpty())
+            digest.add(integers._data.data(), integers._data.size() * sizeof(int64_t));
+
+        return sparse.isEmpty() ? key(digest, matrix.rows(), matrix.cols(), false, mode)
+                                : key(digest, sparse.rows(), sparse.cols(), true, mode);
+    }
+
+    // key of the elements in the digest, for matrices which are never loaded whole
+    static std::string key(Digest digest, size_t rows, size_t cols, bool isSparse, const std::string &mode)
+    {
+        const uint64_t dimensions[] = {rows, cols, isSparse ? 1u : 0u};
+        digest.add(dimensions, sizeof(dimensions));
+
+        std::ostringstream res;
+        res << std::hex << std::setfill('0') << std::setw(16) << digest._fnv << std::setw(16) << digest._polynomial
+            << std::dec << "-" << rows << "x" << cols << "-" << mode;
+        return res.str();
+    }
+
+    bool find(const std::string &key, std::string &result)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        const auto it = _memory.find(key);
+        if(it != _memory.end())
+        {
+            _recent.splice(_recent.begin(), _recent, it->second);
+            result = it->second->second;
+            _statistics._hits++;
+            _statistics._memoryHits++;
+            return true;
+        }
+
+        const auto path = entryPath(key);
+        std::ifstream in(path);
+        std::string stored;
+        if(!in || !std::getline(in, stored) || stored != key || !std::getline(in, result))
+        {
+            _statistics._misses++;
+            return false;
+        }
+
+        // the file is recently used now
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+        remember(key, result);
+        _statistics._hits++;
+        return true;
+    }
+
+    // written to a temporary file and renamed, so other processes never see a half written entry
+    void insert(const std::string &key, const std::string &result)
+    {
+        namespace fs = std::filesystem;
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        remember(key, result);
+
+        std::ostringstream suffix;
+        suffix << ".tmp" << std::this_thread::get_id();
+
+        const auto path = entryPath(key);
+        const auto temporary = path.string() + suffix.str();
+        {
+            std::ofstream out(temporary, std::ios::trunc);
+            out << key << "\n" << result << "\n";
+            if(!out)
+                return;
+        }
+
+        std::error_code error;
+        const auto replaced = fs::exists(path, error) ? fs::file_size(path, error) : 0;
+        fs::rename(temporary, path, error);
+        if(error)
+        {
+            fs::remove(temporary, error);
+            return;
+        }
+
+        _diskSize += key.size() + result.size() + 2;
+        _diskSize -= std::min(_diskSize, static_cast<size_t>(replaced));
+
+        if(_diskSize > _capacity)
+            evict();
+    }
+
+    // the cached result of the key or the computed one, which is cached then
+    template<class Compute>
+    std::string get(const std::string &key, const Compute &compute)
+    {
+        std::string res;
+        if(find(key, res))
+            return res;
+
+        res = compute();
+        insert(key, res);
+        return res;
+    }
+
+    Statistics statistics() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _statistics;
+    }
+
+    size_t diskSize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _diskSize;
+    }
+
+private:
+    static constexpr uint64_t s_FnvOffset = 14695981039346656037ull;
+    static constexpr uint64_t s_FnvPrime = 1099511628211ull;
+    static constexpr uint64_t s_PolynomialBase = 0x9e3779b97f4a7c15ull;
+    static constexpr const char *s_Extension = ".det";
+
+    static bool isEntry(const std::filesystem::directory_entry &entry)
+    {
+        return entry.is_regular_file() && entry.path().extension() == s_Extension;
+    }
+
+    std::filesystem::path entryPath(const std::string &key) const
+    {
+        return _directory / (key + s_Extension);
+    }
+
+    void remember(const std::string &key, const std::string &result)
+    {
+        if(!_memoryEntries)
+            return;
+
+        const auto it = _memory.find(key);
+        if(it != _memory.end())
+        {
+            it->second->second = result;
+            _recent.splice(_recent.begin(), _recent, it->second);
+            return;
+        }
+
+        _recent.emplace_front(key, result);
+        _memory.emplace(key, _recent.begin());
+
+        if(_memory.size() > _memoryEntries)
+        {
+            _memory.erase(_recent.back().first);
+            _recent.pop_back();
+        }
+    }
+
+    // the oldest files go first, the size is counted again as other processes may share the directory
+    void evict()
+    {
+        namespace fs = std::filesystem;
+
+        std::vector<std::pair<fs::file_time_type, fs::directory_entry>> entries;
+        size_t size = 0;
+        for(const auto &entry : fs::directory_iterator(_directory))
+            if(isEntry(entry))
+            {
+                entries.emplace_back(entry.last_write_time(), entry);
+                size += entry.file_size();
+            }
+
+        std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b){ return a.first < b.first; });
+
+        const auto target = static_cast<size_t>(_capacity * s_EvictTo);
+        for(auto it = entries.begin(); it != entries.end() && size > target; ++it)
+        {
+            const auto bytes = it->second.file_size();
+            std::error_code error;
+            if(fs::remove(it->second.path(), error))
+            {
+                size -= bytes;
+                _statistics._evictions++;
+            }
+        }
+
+        _diskSize = size;
+    }
+
+    std::filesystem::path _directory;
+    size_t _capacity;
+    size_t _memoryEntries;
+    size_t _diskSize = 0;
+
+    std::list<std::pair<std::string, std::string>> _recent;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> _memory;
+
+    Statistics _statistics;
+    mutable std::mutex _mutex;
+};
+
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Profile.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MATH_AVX2_BATCH 1
+#endif
+
+namespace math {
+
+// the biggest size with a compile-time kernel, 2^N minors stay on the stack
+constexpr static size_t g_FixedMatrixMaxSize = 8;
+
+// N x N matrix on the stack for the small sizes which dominate the calls.
+// The determinant is the cofactor expansion along rows top to bottom with the minors of
+// the last rows memoized by the bitmask of their columns, as the subset expansion of Matrix,
+// but every mask, row, column and sign is a template argument: the whole expansion unrolls
+// to a straight line of N * 2^(N - 1) multiplications without branches, heap or index tables.
+// No division, so integer matrices get the exact value while it fits the mantissa.
+template<size_t N>
+class FixedMatrix {
+public:
+    static_assert(N >= 1 && N <= g_FixedMatrixMaxSize, "No fixed size kernel for this size");
+
+    static constexpr size_t s_Size = N;
+    static constexpr size_t s_Minors = size_t(1) << N;
+
+    constexpr double &operator()(size_t r, size_t c) { return _data[r * N + c]; }
+    constexpr double operator()(size_t r, size_t c) const { return _data[r * N + c]; }
+
+    // from anything with element(r, c)
+    template<class Element>
+    static constexpr FixedMatrix fromElements(const Element &element)
+    {
+        FixedMatrix res;
+        for(size_t r = 0; r < N; r++)
+            for(size_t c = 0; c < N; c++)
+                res(r, c) = element(r, c);
+
+        return res;
+    }
+
+    constexpr double determinant() const
+    {
+        std::array<double, s_Minors> minors{};
+        minors[0] = 1.;
+        expand(_data.data(), minors.data(), std::make_index_sequence<s_Minors - 1>());
+        return minors[s_Minors - 1];
+    }
+
+    // Determinants of count matrices. Four matrices at a time are transposed into AVX lanes,
+    // element k of all four in one register, and go through the same expansion, so every
+    // result is bit for bit the one of determinant(); the rest are computed one by one.
+    static void determinants(const FixedMatrix *matrices, size_t count, double *out)
+    {
+        size_t i = 0;
+
+        if(hasAvx2())
+            i = determinantsAvx2(matrices, count, out);
+
+        for(; i < count; i++)
+            out[i] = matrices[i].determinant();
+    }
+
+    static bool hasAvx2()
+    {
+#ifdef MATH_AVX2_BATCH
+        static const bool res = __builtin_cpu_supports("avx2");
+        return res;
+#else
+        return false;
+#endif
+    }
+
+    std::array<double, N * N> _data{};
+
+private:
+    static constexpr size_t popcount(size_t mask)
+    {
+        size_t res = 0;
+        for(; mask; mask &= mask - 1)
+            res++;
+
+        return res;
+    }
+
+    // minors[mask] for every mask in increasing order, so the smaller ones are ready
+    template<class T, size_t... Mask>
+    static constexpr void expand(const T *elements, T *minors, std::index_sequence<Mask...>)
+    {
+        (expandMask<T, Mask + 1>(elements, minors, std::make_index_sequence<N>()), ...);
+    }
+
+    // the minor of the last popcount(Mask) rows over the columns of Mask
+    template<class T, size_t Mask, size_t... Col>
+    static constexpr void expandMask(const T *elements, T *minors, std::index_sequence<Col...>)
+    {
+        constexpr auto row = N - popcount(Mask);
+
+        T sum{};
+        (addCofactor<T, Mask, Col>(elements[row * N + Col], minors, sum), ...);
+        minors[Mask] = sum;
+    }
+
+    template<class T, size_t Mask, size_t Col>
+    static constexpr void addCofactor(const T &element, const T *minors, T &sum)
+    {
+        constexpr auto bit = size_t(1) << Col;
+        if constexpr((Mask & bit) != 0)
+        {
+            constexpr auto before = popcount(Mask & (bit - 1));
+            const T term = element * minors[Mask ^ bit];
+
+            if constexpr(before == 0)
+                sum = term;
+            else if constexpr(before % 2 == 0)
+                sum = sum + term;
+            else
+                sum = sum - term;
+        }
+    }
+
+#ifdef MATH_AVX2_BATCH
+    // no FMA on purpose: contracted products would round differently from determinant()
+    __attribute__((target("avx2")))
+    static size_t determinantsAvx2(const FixedMatrix *matrices, size_t count, double *out)
+    {
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m256d elements[N * N];
+            for(size_t k = 0; k < N * N; k++)
+                elements[k] = _mm256_set_pd(matrices[i + 3]._data[k], matrices[i + 2]._data[k],
+                                            matrices[i + 1]._data[k], matrices[i]._data[k]);
+
+            __m256d minors[s_Minors];
+            minors[0] = _mm256_set1_pd(1.);
+            expand(elements, minors, std::make_index_sequence<s_Minors - 1>());
+
+            _mm256_storeu_pd(out + i, minors[s_Minors - 1]);
+        }
+
+        return i;
+    }
+#else
+    static size_t determinantsAvx2(const FixedMatrix *, size_t, double *)
+    {
+        return 0;
+    }
+#endif
+};
+
+// runtime dispatch by size to the kernel of that size, element(r, c) for r, c < n
+template<class Element>
+double calculateDeterminantFixed(size_t n, const Element &element)
+{
+    MATH_PROFILE_COUNT(fixedKernels, 1);
+
+    switch (n) {
+    case 1:
+        return FixedMatrix<1>::fromElements(element).determinant();
+    case 2:
+        return FixedMatrix<2>::fromElements(element).determinant();
+    case 3:
+        return FixedMatrix<3>::fromElements(element).determinant();
+    case 4:
+        return FixedMatrix<4>::fromElements(element).determinant();
+    case 5:
+        return FixedMatrix<5>::fromElements(element).determinant();
+    case 6:
+        return FixedMatrix<6>::fromElements(element).determinant();
+    case 7:
+        return FixedMatrix<7>::fromElements(element).determinant();
+    case 8:
+        return FixedMatrix<8>::fromElements(element).determinant();
+    }
+
+    throw std::runtime_error("No fixed size kernel for the size " + std::to_string(n));
+}
+
+}
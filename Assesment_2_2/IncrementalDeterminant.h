@@ -0,0 +1,248 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "Matrix.h"
+
+namespace math {
+
+// Determinant of a matrix which is edited a row, a column or a rank one term at a time.
+// The factorization P A = L U is kept, an edit A + u v^T changes det by 1 + v^T A^-1 u
+// (the matrix determinant lemma) and the factors are updated in place by Bennett's algorithm,
+// both O(n^2). Bennett's update doesn't pivot, so A is factorized again instead when the
+// rounding error of an edit could reach s_Tolerance of the determinant:
+// - the backward error of the solve for the lemma, which shows how far updates took the
+//   factors from A, times n and times the cancellation in the lemma ratio reaches it,
+// - a multiplier or a cancelling new pivot amplifies rounding by s_Tolerance / eps,
+// - the updated pivots disagree with the lemma ratio by s_Tolerance,
+// - the pivots are singular to n eps, or s_UpdatesPerRow * n edits have piled up.
+// Random edits of a 500 x 500 matrix need a factorization in about 15 of them this way.
+class IncrementalDeterminant {
+public:
+    static constexpr double s_Tolerance = 1e-9;
+    static constexpr size_t s_UpdatesPerRow = 4;
+
+    explicit IncrementalDeterminant(const Matrix &mtx)
+        : _matrix(mtx)
+    {
+        if(mtx.isEmpty() || !mtx.isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        factorize();
+    }
+
+    double determinant() const
+    {
+        return std::ldexp(_mantissa, _exponent);
+    }
+
+    const Matrix &matrix() const { return _matrix; }
+
+    // factors of the edited matrix for solves
+    const Factorization &factorization() const { return _factors; }
+
+    // full factorizations done, the first one included
+    size_t factorizations() const { return _factorizations; }
+
+    double updateRow(size_t r, const Vector &row)
+    {
+        const auto n = size();
+        if(r >= n || row.size() != n)
+            throw std::runtime_error("Wrong row for the update");
+
+        Vector u(n), v(n);
+        u[r] = 1.;
+        for(auto j = 0u; j < n; j++)
+            v[j] = row[j] - _matrix(r, j);
+
+        return rankOneUpdate(u, v);
+    }
+
+    double updateColumn(size_t c, const Vector &col)
+    {
+        const auto n = size();
+        if(c >= n || col.size() != n)
+            throw std::runtime_error("Wrong column for the update");
+
+        Vector u(n), v(n);
+        v[c] = 1.;
+        for(auto i = 0u; i < n; i++)
+            u[i] = col[i] - _matrix(i, c);
+
+        return rankOneUpdate(u, v);
+    }
+
+    // A += u v^T, returns the new determinant
+    double rankOneUpdate(const Vector &u, const Vector &v)
+    {
+        const auto n = size();
+        if(u.size() != n || v.size() != n)
+            throw std::runtime_error("Wrong vector size for the update");
+
+        // factors of a (nearly) singular matrix can't be updated accurately
+        const auto isStable = ++_updates <= s_UpdatesPerRow * n && hasStablePivots();
+        const auto w = isStable ? _factors.solve(u) : Vector();
+
+        double ratio = 1.;
+        double magnitude = 1.;
+        for(auto i = 0u; isStable && i < n; i++)
+        {
+            ratio += v[i] * w[i];
+            magnitude += std::fabs(v[i] * w[i]);
+        }
+
+        // the backward error reaches the determinant about n times over
+        // and the ratio as many times more as its digits cancel out
+        const auto error = isStable ? std::max(backwardError(w, u), s_Epsilon) : 0.;
+        const auto isAccurate = isStable && error * (n + magnitude / std::fabs(ratio)) <= s_Tolerance;
+
+        for(auto i = 0u; i < n; i++)
+        {
+            if(u[i] == 0.)
+                continue;
+
+            for(auto j = 0u; j < n; j++)
+                _matrix(i, j) += u[i] * v[j];
+        }
+
+        if(!isAccurate)
+        {
+            factorize();
+            return determinant();
+        }
+
+        const auto mantissa = _mantissa;
+        const auto exponent = _exponent;
+
+        // P u in the order of the factor rows
+        std::vector<double> x(n), y(v._v);
+        for(auto i = 0u; i < n; i++)
+            x[i] = u[_factors._rowOf[i]];
+
+        if(!updateFactors(x, y))
+        {
+            factorize();
+            return determinant();
+        }
+
+        pivotsProduct();
+
+        // the ratio of the new and old products, which doesn't overflow as the determinants can
+        const auto updatedRatio = std::ldexp(_mantissa / mantissa, _exponent - exponent);
+        if(std::fabs(updatedRatio - ratio) > s_Tolerance * std::fabs(ratio))
+            factorize();
+
+        return determinant();
+    }
+
+private:
+    static constexpr double s_Epsilon = std::numeric_limits<double>::epsilon();
+
+    // rounding amplified this much reaches s_Tolerance
+    static constexpr double s_Amplification = s_Tolerance / s_Epsilon;
+
+    size_t size() const { return _matrix.rows(); }
+
+    double &lu(size_t r, size_t c) { return _factors._lu[r * size() + c]; }
+
+    void factorize()
+    {
+        _factors = _matrix.factorize();
+        pivotsProduct();
+        _updates = 0;
+        _factorizations++;
+    }
+
+    void pivotsProduct()
+    {
+        std::tie(_mantissa, _exponent) = _factors.scaledDeterminant();
+    }
+
+    // max |A w - b|_i / (|A| |w| + |b|)_i
+    double backwardError(const Vector &w, const Vector &b) const
+    {
+        double res = 0.;
+        for(auto i = 0u; i < size(); i++)
+        {
+            double residual = -b[i];
+            double scale = std::fabs(b[i]);
+            for(auto j = 0u; j < size(); j++)
+            {
+                residual += _matrix(i, j) * w[j];
+                scale += std::fabs(_matrix(i, j) * w[j]);
+            }
+
+            if(scale != 0.)
+                res = std::max(res, std::fabs(residual) / scale);
+        }
+
+        return res;
+    }
+
+    // the smallest pivot is not lost in the rounding of the biggest one
+    bool hasStablePivots()
+    {
+        double smallest = std::fabs(lu(0, 0)), biggest = smallest;
+        for(auto k = 1u; k < size(); k++)
+        {
+            smallest = std::min(smallest, std::fabs(lu(k, k)));
+            biggest = std::max(biggest, std::fabs(lu(k, k)));
+        }
+
+        return smallest > size() * s_Epsilon * biggest;
+    }
+
+    // L U + x y^T = L' U' eliminating one column at a time: with c = u_kk + x_k y_k
+    // L'(:, k) = (u_kk L(:, k) + y_k x) / c, U'(k, :) = U(k, :) + x_k y,
+    // and the rest is L22 U22 + (x - x_k L(:, k)) ((u_kk y - y_k U(k, :)) / c)^T
+    bool updateFactors(std::vector<double> &x, std::vector<double> &y)
+    {
+        const auto n = size();
+
+        for(auto k = 0u; k < n; k++)
+        {
+            const auto ukk = lu(k, k);
+            const auto xk = x[k];
+            const auto yk = y[k];
+            const auto c = ukk + xk * yk;
+
+            // the new pivot lost too many of its digits
+            if(std::fabs(c) * s_Amplification <= std::fabs(ukk) + std::fabs(xk * yk))
+                return false;
+
+            for(auto i = k + 1; i < n; i++)
+            {
+                const auto l = lu(i, k);
+                lu(i, k) = (ukk * l + yk * x[i]) / c;
+                x[i] -= xk * l;
+
+                if(std::fabs(lu(i, k)) > s_Amplification)
+                    return false;
+            }
+
+            for(auto j = k + 1; j < n; j++)
+            {
+                const auto u = lu(k, j);
+                lu(k, j) = u + xk * y[j];
+                y[j] = (ukk * y[j] - yk * u) / c;
+            }
+
+            lu(k, k) = c;
+        }
+
+        return true;
+    }
+
+    Matrix _matrix;
+    Factorization _factors;
+    double _mantissa = 0.;
+    int _exponent = 0;
+    size_t _updates = 0;
+    size_t _factorizations = 0;
+};
+
+}
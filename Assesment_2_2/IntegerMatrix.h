@@ -0,0 +1,332 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "BigInteger.h"
+#include "ModularArithmetic.h"
+#include "Profile.h"
+
+namespace math {
+
+// square matrix of exact integers, row-major like Matrix
+class IntegerMatrix {
+public:
+    IntegerMatrix() = default;
+
+    void addRow(std::vector<int64_t> &&row)
+    {
+        if(_rows && _cols != row.size())
+            throw std::runtime_error("Numbers of columns is defferent");
+
+        _cols = row.size();
+        _data.insert(_data.end(), row.begin(), row.end());
+        _rows++;
+    }
+
+    bool isEmpty() const { return !_rows; }
+    bool isSquare() const { return _rows == _cols; }
+
+    size_t rows() const { return _rows; }
+    size_t cols() const { return _cols; }
+
+    int64_t operator()(size_t r, size_t c) const { return _data[r * _cols + c]; }
+
+    void clear()
+    {
+        _data.clear();
+        _rows = 0;
+        _cols = 0;
+    }
+
+    // fraction-free gaussian elimination: every division is exact, so the result is exact.
+    // Runs on __int128 and moves to BigInteger from the step where an intermediate overflows.
+    BigInteger calculateDeterminantBareiss() const
+    {
+        if(!isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        const auto n = _rows;
+        if(!n)
+            return BigInteger(1ll);
+
+        std::vector<__int128> a(_data.begin(), _data.end());
+        __int128 previous = 1;
+        bool negative = false;
+
+        size_t k = 0;
+        bool isZero = false;
+
+        for(; k + 1 < n; k++)
+        {
+            if(!pivot(a, n, k, negative))
+            {
+                isZero = true;
+                break;
+            }
+
+            if(!eliminate(a, n, k, previous))
+                break;
+
+            previous = a[k * n + k];
+        }
+
+        if(isZero)
+            return BigInteger(0ll);
+
+        if(k + 1 >= n)
+        {
+            const BigInteger det(a[(n - 1) * n + n - 1]);
+            return negative ? -det : det;
+        }
+
+        // overflow on step k: step k is recomputed from the untouched __int128 state
+        std::vector<BigInteger> b(a.begin(), a.end());
+        BigInteger bigPrevious(previous);
+
+        for(; k + 1 < n; k++)
+        {
+            if(!pivot(b, n, k, negative))
+                return BigInteger(0ll);
+
+            eliminate(b, n, k, bigPrevious);
+            bigPrevious = b[k * n + k];
+        }
+
+        const auto &det = b[(n - 1) * n + n - 1];
+        return negative ? -det : det;
+    }
+
+    // bits of Hadamard's bound |det| <= product of row norms
+    size_t hadamardBits() const
+    {
+        long double bits = 0.;
+        for(auto i = 0u; i < _rows; i++)
+        {
+            long double norm = 0.;
+            for(auto j = 0u; j < _cols; j++)
+            {
+                const long double v = (*this)(i, j);
+                norm += v * v;
+            }
+
+            if(norm == 0.)
+                return 0;
+
+            bits += std::log2(norm) / 2;
+        }
+
+        return static_cast<size_t>(std::ceil(bits)) + 1;
+    }
+
+    // gaussian elimination over Z/pZ
+    uint64_t determinantModulo(const Montgomery &field) const
+    {
+        const auto n = _rows;
+        std::vector<uint64_t> a(_data.size());
+        for(auto i = 0u; i < a.size(); i++)
+            a[i] = field.toMontgomery(_data[i]);
+
+        auto det = field.one();
+
+        for(auto k = 0u; k < n; k++)
+        {
+            auto p = k;
+            while(p < n && !a[p * n + k])
+                p++;
+
+            if(p == n)
+                return 0;
+
+            if(p != k)
+            {
+                for(auto j = k; j < n; j++)
+                    std::swap(a[p * n + j], a[k * n + j]);
+
+                det = field.subtract(0, det);
+            }
+
+            const auto akk = a[k * n + k];
+            det = field.multiply(det, akk);
+            const auto inverse = field.inverse(akk);
+
+            for(auto i = k + 1; i < n; i++)
+            {
+                if(!a[i * n + k])
+                    continue;
+
+                const auto factor = field.multiply(a[i * n + k], inverse);
+                for(auto j = k + 1; j < n; j++)
+                    a[i * n + j] = field.subtract(a[i * n + j], field.multiply(factor, a[k * n + j]));
+            }
+        }
+
+        return field.fromMontgomery(det);
+    }
+
+    // det modulo enough 62-bit primes to cover the Hadamard bound, one prime per task on
+    // every thread, then the exact value is rebuilt with the Chinese remainder theorem
+    BigInteger calculateDeterminantModular(size_t threads = 0) const
+    {
+        if(!isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        if(!_rows)
+            return BigInteger(1ll);
+
+        const auto bits = hadamardBits();
+        if(!bits)
+            return BigInteger(0ll);
+
+        // every prime is above 2^61, one more bit for the sign
+        const auto primes = largePrimes((bits + 1) / 61 + 1);
+        std::vector<uint64_t> residues(primes.size());
+
+        if(!threads)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, primes.size());
+
+        std::atomic<size_t> next{0};
+        auto worker = [&](){
+            for(auto i = next++; i < primes.size(); i = next++)
+                residues[i] = determinantModulo(Montgomery(primes[i]));
+        };
+
+        std::vector<std::thread> pool;
+        for(auto t = 1u; t < threads; t++)
+            pool.emplace_back(worker);
+
+        worker();
+        for(auto &thread : pool)
+            thread.join();
+
+        return reconstruct(primes, residues);
+    }
+
+    std::vector<int64_t> _data;
+    size_t _rows = 0;
+    size_t _cols = 0;
+
+private:
+    // Garner's mixed radix form x = c0 + c1 p0 + c2 p0 p1 + ..., all digits are found
+    // with 64-bit arithmetic and only the final Horner pass works on big numbers
+    static BigInteger reconstruct(const std::vector<uint64_t> &primes, const std::vector<uint64_t> &residues)
+    {
+        const auto k = primes.size();
+        std::vector<uint64_t> digits(k);
+
+        for(auto i = 0u; i < k; i++)
+        {
+            const auto p = primes[i];
+            uint64_t x = residues[i] % p;
+
+            for(auto j = 0u; j < i; j++)
+            {
+                const auto difference = (x + p - digits[j] % p) % p;
+                x = multiplyModulo(difference, powerModulo(primes[j] % p, p - 2, p), p);
+            }
+
+            digits[i] = x;
+        }
+
+        BigInteger res = BigInteger::fromUnsigned(digits[k - 1]);
+        BigInteger product = BigInteger::fromUnsigned(primes[k - 1]);
+
+        for(auto i = k - 1; i-- > 0;)
+        {
+            res = res * BigInteger::fromUnsigned(primes[i]) + BigInteger::fromUnsigned(digits[i]);
+            product = product * BigInteger::fromUnsigned(primes[i]);
+        }
+
+        // symmetric range (-M/2, M/2]
+        if(product < res + res)
+            res = res - product;
+
+        return res;
+    }
+
+    template<class T>
+    static bool isZeroValue(const T &v)
+    {
+        if constexpr(std::is_same_v<T, BigInteger>)
+            return v.isZero();
+        else
+            return v == 0;
+    }
+
+    // moves a row with non-zero element in column k to row k, false when there is none
+    template<class T>
+    static bool pivot(std::vector<T> &a, size_t n, size_t k, bool &negative)
+    {
+        MATH_PROFILE_COUNT(pivots, 1);
+
+        if(!isZeroValue(a[k * n + k]))
+            return true;
+
+        for(auto i = k + 1; i < n; i++)
+        {
+            if(isZeroValue(a[i * n + k]))
+                continue;
+
+            MATH_PROFILE_COUNT(rowSwaps, 1);
+
+            for(auto j = k; j < n; j++)
+                std::swap(a[i * n + j], a[k * n + j]);
+
+            negative = !negative;
+            return true;
+        }
+
+        return false;
+    }
+
+    static bool eliminate(std::vector<__int128> &a, size_t n, size_t k, __int128 previous)
+    {
+        const auto akk = a[k * n + k];
+
+        // all products of the step are checked first, so the state stays consistent on overflow
+        std::vector<__int128> next((n - k - 1) * (n - k - 1));
+
+        for(auto i = k + 1; i < n; i++)
+        {
+            const auto aik = a[i * n + k];
+            for(auto j = k + 1; j < n; j++)
+            {
+                __int128 left;
+                __int128 right;
+                __int128 diff;
+
+                if(__builtin_mul_overflow(a[i * n + j], akk, &left)
+                   || __builtin_mul_overflow(aik, a[k * n + j], &right)
+                   || __builtin_sub_overflow(left, right, &diff))
+                    return false;
+
+                next[(i - k - 1) * (n - k - 1) + j - k - 1] = diff / previous;
+            }
+        }
+
+        for(auto i = k + 1; i < n; i++)
+            for(auto j = k + 1; j < n; j++)
+                a[i * n + j] = next[(i - k - 1) * (n - k - 1) + j - k - 1];
+
+        return true;
+    }
+
+    static void eliminate(std::vector<BigInteger> &a, size_t n, size_t k, const BigInteger &previous)
+    {
+        const auto &akk = a[k * n + k];
+
+        for(auto i = k + 1; i < n; i++)
+        {
+            const auto aik = a[i * n + k];
+            for(auto j = k + 1; j < n; j++)
+                a[i * n + j] = (a[i * n + j] * akk - aik * a[k * n + j]) / previous;
+        }
+    }
+};
+
+}
@@ -2,9 +2,47 @@
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#include "BlockedLU.h"
+#include "FixedMatrix.h"
+#include "IntegerMatrix.h"
+#include "Profile.h"
+#include "SparseMatrix.h"
+#include "TaskPool.h"
 
 namespace math {
 
+enum class DeterminantAlgorithm : int {
+    laplace = 0,
+    lu,
+    lu_blocked,
+    lu_sparse,
+    laplace_dp,
+    laplace_parallel,
+    bareiss,
+    modular,
+    laplace_fixed,
+    automatic,
+};
+
+const static std::unordered_map<std::string, DeterminantAlgorithm> g_DeterminantAlgorithms = {
+    {"laplace", DeterminantAlgorithm::laplace },
+    {"lu", DeterminantAlgorithm::lu },
+    {"lu-blocked", DeterminantAlgorithm::lu_blocked },
+    {"lu-sparse", DeterminantAlgorithm::lu_sparse },
+    {"laplace-dp", DeterminantAlgorithm::laplace_dp },
+    {"laplace-parallel", DeterminantAlgorithm::laplace_parallel },
+    {"bareiss", DeterminantAlgorithm::bareiss },
+    {"modular", DeterminantAlgorithm::modular },
+    {"laplace-fixed", DeterminantAlgorithm::laplace_fixed },
+    {"auto", DeterminantAlgorithm::automatic },
+};
+
 class Vector {
 public:
     Vector() = default;
@@ -37,6 +75,10 @@ public:
     std::vector<double> _v;
 };
 
+class MatrixView;
+class Factorization;
+
+// row-major matrix in one contiguous buffer, element (r, c) is at r * cols + c
 class Matrix {
 public:
     Matrix() = default;
@@ -46,72 +88,323 @@ public:
         if(!row || !col)
             throw std::runtime_error("Empty matrix");
 
-        _v.resize(row, Vector(col));
+        _rows = row;
+        _cols = col;
+        _data.resize(row * col, 0.);
     }
 
     void addRow(Vector &&row)
     {
-        if(!_v.empty() && _v[0].size() != row.size())
+        if(_rows && _cols != row.size())
             throw std::runtime_error("Numbers of columns is defferent");
 
-        _v.emplace_back(std::move(row));
+        _cols = row.size();
+
+#ifdef MATH_PROFILE
+        const auto capacity = _data.capacity();
+        _data.insert(_data.end(), row._v.begin(), row._v.end());
+        MATH_PROFILE_COUNT(addRowBytes, (_data.capacity() - capacity) * sizeof(double));
+#else
+        _data.insert(_data.end(), row._v.begin(), row._v.end());
+#endif
+
+        _rows++;
     }
 
     bool isEmpty() const
     {
-        return _v.empty();
+        return !_rows;
     }
 
     bool isSquare() const
     {
-        if(_v.empty())
+        if(!_rows)
             return true;
 
-        return _v.size() == _v[0].size();
+        return _rows == _cols;
     }
 
+    size_t rows() const { return _rows; }
+    size_t cols() const { return _cols; }
+
+    double *data() { return _data.data(); }
+    const double *data() const { return _data.data(); }
+
     double &operator()(size_t r, size_t c) {
-        return _v[r][c];
+        return _data[r * _cols + c];
     }
 
     const double &operator()(size_t r, size_t c) const {
-        return _v[r][c];
+        return _data[r * _cols + c];
     }
 
     friend std::ostream& operator<<(std::ostream& out, const Matrix& mtx)
     {
-        for(auto i = 0u; i < mtx._v.size(); i++)
-            out << mtx._v[i];
+        for(auto i = 0u; i < mtx._rows; i++)
+        {
+            for(auto j = 0u; j < mtx._cols; j++)
+                out << mtx(i, j) << " ";
+
+            out << std::endl;
+        }
 
         out << std::endl;
         return out;
     }
 
     template<bool amongRows>
-    std::pair<size_t, size_t> calculateVectorWithBiggestNumberOfZeroElements() const
+    std::pair<size_t, size_t> calculateVectorWithBiggestNumberOfZeroElements() const;
+
+    MatrixView minor(size_t r, size_t c) const;
+
+    double algebraicСomplement(size_t r, size_t c) const;
+
+    double calculateDeterminantLaplaceExpansion() const;
+
+    // the same expansion with the unrolled kernels for minors of their sizes
+    double calculateDeterminantLaplaceFixed() const;
+
+    // minors up to this size are expanded sequentially inside one task
+    static constexpr size_t s_LaplaceCutoff = 7;
+
+    double calculateDeterminantLaplaceParallel(size_t threads = 0, size_t cutoff = s_LaplaceCutoff) const;
+
+    // the same elimination in cache blocks on all threads, for big dense matrices
+    double calculateDeterminantBlockedLU(size_t threads = 0, size_t blockSize = BlockedLU::s_BlockSize) const
     {
-        size_t vectorNumber = 0;
-        size_t numberOfZeroElements = 0;
+        if(!isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        std::vector<double> a = _data;
+        TaskPool pool(threads ? threads : std::thread::hardware_concurrency());
+        return BlockedLU::determinant(a, _rows, pool, blockSize);
+    }
+
+    // O(n^3) gaussian elimination with partial pivoting: det = sign * product of pivots
+    double calculateDeterminantLU() const;
+
+    // the same elimination with the factors kept for solves, inverse and log-determinant
+    Factorization factorize() const;
+
+    // cofactor expansion along rows in order with memoized minors: the minor of the last
+    // popcount(mask) rows is keyed by the bitmask of its columns, O(n * 2^n) time and 2^n memory,
+    // 256 MB of minors at the largest size
+    double calculateDeterminantSubsetExpansion() const
+    {
+        if(!isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        static const size_t s_MaxSize = 25;
+
+        const auto n = _rows;
+        if(n > s_MaxSize)
+            throw std::runtime_error("Matrix is too big for the subset expansion, max size is " + std::to_string(s_MaxSize));
+
+        std::vector<double> minors(size_t(1) << n, 0.);
+        minors[0] = 1.;
 
-        for(auto i = 0u; i < _v.size(); i++)
+        for(size_t mask = 1; mask < minors.size(); mask++)
         {
-            size_t currentNumberOfZeroElements = 0;
+            const auto row = n - __builtin_popcountll(mask);
+            const double *rowData = &_data[row * n];
 
-            for(auto j = 0u; j < _v.size(); j++)
+            double res = 0.;
+            auto sign = 1.;
+
+            for(auto j = 0u; j < n; j++)
             {
-                double elem = 0;
-                if constexpr(amongRows)
-                    elem = (*this)(i,j);
-                else
-                    elem = (*this)(j,i);
-
-                if(elem == 0.0)
-                    currentNumberOfZeroElements++;
+                const auto bit = size_t(1) << j;
+                if(!(mask & bit))
+                    continue;
+
+                const auto v = rowData[j];
+                const auto minor = minors[mask ^ bit];
+
+                if(v != 0. && minor != 0.)
+                    res += sign * v * minor;
+
+                sign = -sign;
             }
 
-            if(currentNumberOfZeroElements > numberOfZeroElements)
+            minors[mask] = res;
+        }
+
+        return minors.back();
+    }
+
+    SparseMatrix toSparse() const
+    {
+        return SparseMatrix::fromDense(_data.data(), _rows, _cols);
+    }
+
+    static Matrix fromSparse(const SparseMatrix &sparse)
+    {
+        if(sparse.isEmpty() || !sparse.cols())
+            return Matrix();
+
+        Matrix res(sparse.rows(), sparse.cols());
+        sparse.toDense(res.data());
+        return res;
+    }
+
+    double density() const
+    {
+        if(_data.empty())
+            return 0.;
+
+        return static_cast<double>(_data.size() - std::count(_data.begin(), _data.end(), 0.)) / _data.size();
+    }
+
+    // exact copy when every element is an integer representable in int64_t
+    bool toIntegers(IntegerMatrix &res) const
+    {
+        res.clear();
+
+        for(auto i = 0u; i < _rows; i++)
+        {
+            std::vector<int64_t> row;
+            row.reserve(_cols);
+
+            for(auto j = 0u; j < _cols; j++)
             {
-                numberOfZeroElements = currentNumberOfZeroElements;
+                const auto v = (*this)(i, j);
+                if(std::trunc(v) != v || std::fabs(v) >= 9.2e18)
+                {
+                    res.clear();
+                    return false;
+                }
+
+                row.push_back(static_cast<int64_t>(v));
+            }
+
+            res.addRow(std::move(row));
+        }
+
+        return true;
+    }
+
+    // the exact algorithms are chosen automatically up to this size and Hadamard bound,
+    // modular elimination costs O(n^3) for every 61 bits of the bound
+    static constexpr size_t s_ExactMaxSize = 64;
+    static constexpr size_t s_ExactMaxBits = 1024;
+
+    // integer input within the exact limits goes to exact Bareiss or to multi-modular elimination
+    // when it is big, small matrices to Laplace, big sparse ones to sparse LU, the rest to LU
+    // and blocked LU when it is big
+    static DeterminantAlgorithm automaticAlgorithm(size_t n, bool isInteger, double density = 1., size_t hadamardBits = 0)
+    {
+        if(isInteger && n <= s_ExactMaxSize && hadamardBits <= s_ExactMaxBits)
+            return n <= 16 ? DeterminantAlgorithm::bareiss : DeterminantAlgorithm::modular;
+
+        if(n >= SparseMatrix::s_SparseMinSize && density <= SparseMatrix::s_SparseDensity)
+            return DeterminantAlgorithm::lu_sparse;
+
+        if(n <= g_FixedMatrixMaxSize)
+            return DeterminantAlgorithm::laplace_fixed;
+
+        return n < 128 ? DeterminantAlgorithm::lu : DeterminantAlgorithm::lu_blocked;
+    }
+
+    // threads = 0 means all hardware threads, for the algorithms which run in parallel
+    double calculateDeterminant(DeterminantAlgorithm algorithm, size_t threads = 0) const
+    {
+        switch (algorithm) {
+        case DeterminantAlgorithm::laplace:
+            return calculateDeterminantLaplaceExpansion();
+        case DeterminantAlgorithm::laplace_fixed:
+            return calculateDeterminantLaplaceFixed();
+        case DeterminantAlgorithm::lu:
+            return calculateDeterminantLU();
+        case DeterminantAlgorithm::lu_blocked:
+            return calculateDeterminantBlockedLU(threads);
+        case DeterminantAlgorithm::lu_sparse:
+            if(!isSquare())
+                throw std::runtime_error("Matrix should be square");
+
+            return toSparse().calculateDeterminantLU();
+        case DeterminantAlgorithm::laplace_dp:
+            return calculateDeterminantSubsetExpansion();
+        case DeterminantAlgorithm::laplace_parallel:
+            return calculateDeterminantLaplaceParallel(threads);
+        case DeterminantAlgorithm::bareiss:
+        {
+            IntegerMatrix integers;
+            if(!toIntegers(integers))
+                throw std::runtime_error("Bareiss algorithm requires integer matrix");
+
+            return integers.calculateDeterminantBareiss().toDouble();
+        }
+        case DeterminantAlgorithm::modular:
+        {
+            IntegerMatrix integers;
+            if(!toIntegers(integers))
+                throw std::runtime_error("Modular algorithm requires integer matrix");
+
+            return integers.calculateDeterminantModular(threads).toDouble();
+        }
+        case DeterminantAlgorithm::automatic:
+        {
+            IntegerMatrix integers;
+            const auto isInteger = toIntegers(integers);
+            return calculateDeterminant(automaticAlgorithm(_rows, isInteger, density(), isInteger ? integers.hadamardBits() : 0), threads);
+        }
+        }
+
+        throw std::runtime_error("Unsupported determinant algorithm");
+    }
+
+    std::vector<double> _data;
+    size_t _rows = 0;
+    size_t _cols = 0;
+};
+
+// square submatrix of a Matrix selected by row and column indexes, elements are not copied.
+// Numbers of zero elements in every row and column are kept along, so minor() is O(n).
+// The viewed matrix should outlive the view.
+class MatrixView {
+public:
+    MatrixView(const Matrix &mtx)
+        : _data(mtx.data()), _stride(mtx.cols()), _size(mtx.rows())
+    {
+        if(!mtx.isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        _buffer.resize(4 * _size, 0);
+
+        for(auto i = 0u; i < _size; i++)
+        {
+            rowIndexes()[i] = i;
+            colIndexes()[i] = i;
+        }
+
+        for(auto i = 0u; i < _size; i++)
+            for(auto j = 0u; j < _size; j++)
+                if((*this)(i, j) == 0.)
+                {
+                    rowZeros()[i]++;
+                    colZeros()[j]++;
+                }
+    }
+
+    size_t size() const { return _size; }
+
+    double operator()(size_t r, size_t c) const {
+        return _data[rowIndexes()[r] * _stride + colIndexes()[c]];
+    }
+
+    template<bool amongRows>
+    std::pair<size_t, size_t> calculateVectorWithBiggestNumberOfZeroElements() const
+    {
+        const size_t *zeros = amongRows ? rowZeros() : colZeros();
+
+        size_t vectorNumber = 0;
+        size_t numberOfZeroElements = 0;
+
+        for(auto i = 0u; i < _size; i++)
+        {
+            if(zeros[i] > numberOfZeroElements)
+            {
+                numberOfZeroElements = zeros[i];
                 vectorNumber = i;
             }
         }
@@ -119,70 +412,385 @@ public:
         return {vectorNumber, numberOfZeroElements};
     }
 
-    Matrix minor(size_t r, size_t c) const
+    MatrixView minor(size_t r, size_t c) const
     {
-        Matrix res;
+        MATH_PROFILE_COUNT(minors, 1);
+        MATH_PROFILE_COUNT(minorBytes, 4 * (_size - 1) * sizeof(size_t));
+
+        MatrixView res(_data, _stride, _size - 1);
 
-        for(auto i = 0; i < _v.size(); i++)
+        for(auto i = 0u, k = 0u; i < _size; i++)
         {
             if(i == r)
                 continue;
 
-            Vector vc;
-
-            for(auto j = 0; j < _v.size(); j++)
-            {
-                if(j == c)
-                    continue;
+            res.rowIndexes()[k] = rowIndexes()[i];
+            res.rowZeros()[k] = rowZeros()[i] - ((*this)(i, c) == 0. ? 1 : 0);
+            k++;
+        }
 
-                vc._v.push_back(_v[i][j]);
-            }
+        for(auto j = 0u, k = 0u; j < _size; j++)
+        {
+            if(j == c)
+                continue;
 
-            res.addRow(std::move(vc));
+            res.colIndexes()[k] = colIndexes()[j];
+            res.colZeros()[k] = colZeros()[j] - ((*this)(r, j) == 0. ? 1 : 0);
+            k++;
         }
 
         return res;
     }
 
-    double algebraicСomplement(size_t r, size_t c) const
+    double algebraicСomplement(size_t r, size_t c, bool kernels = false) const
     {
+        MATH_PROFILE_COUNT(cofactors, 1);
+
         const auto minorRC = minor(r, c);
-        const auto detMinorRC = minorRC.calculateDeterminantLaplaceExpansion();
+        const auto detMinorRC = minorRC.calculateDeterminantLaplaceExpansion(kernels);
 
         const auto sign = (r + c) % 2 == 0 ? 1 : -1;
         return sign * detMinorRC;
     }
 
-    double calculateDeterminantLaplaceExpansion() const
+    // with kernels minors of small sizes go to the unrolled kernels instead of more views
+    double calculateDeterminantLaplaceExpansion(bool kernels = false) const
     {
-        if(_v.size() == 1)
-            return _v[0][0];
+        // views are minors of a square matrix, so the depth is the number of removed rows
+        MATH_PROFILE_MAX(maxDepth, _stride - _size);
 
-        if(_v.size() == 2)
-            return (_v[0][0] * _v[1][1]) - (_v[1][0] * _v[0][1]);
+        if(kernels && _size <= g_FixedMatrixMaxSize)
+            return calculateDeterminantFixed(_size, *this);
 
-        // define a row or column with biggest number of zero elements
-        auto [biggestRow, numZeroElemInRow] = calculateVectorWithBiggestNumberOfZeroElements<true>();
-        auto [biggestCol, numZeroElemInCol] = calculateVectorWithBiggestNumberOfZeroElements<false>();
+        if(_size == 1)
+            return (*this)(0, 0);
 
-        bool alongRows = numZeroElemInRow >= numZeroElemInCol;
-        auto biggestVector = alongRows ? biggestRow : biggestCol;
+        if(_size == 2)
+            return ((*this)(0, 0) * (*this)(1, 1)) - ((*this)(1, 0) * (*this)(0, 1));
+
+        auto [alongRows, biggestVector] = expansionVector();
 
         double res = 0;
-        for(auto i = 0; i < _v.size(); i++)
+        for(auto i = 0u; i < _size; i++)
         {
-            auto v = alongRows ? _v[biggestVector][i] : _v[i][biggestVector];
+            auto v = alongRows ? (*this)(biggestVector, i) : (*this)(i, biggestVector);
             if(v == 0.)
                 continue;
 
-            auto det = alongRows ? algebraicСomplement(biggestVector, i) : algebraicСomplement(i, biggestVector);
+            auto det = alongRows ? algebraicСomplement(biggestVector, i, kernels) : algebraicСomplement(i, biggestVector, kernels);
             res += v * det;
         }
 
         return res;
     }
 
-    std::vector<Vector> _v;
+    // Cofactors of minors bigger than cutoff are spawned as tasks. Every task writes its own
+    // slot and slots are summed in index order, so the result is the same bit for bit
+    // as the sequential expansion for any number of threads.
+    double calculateDeterminantLaplaceExpansion(TaskPool &pool, size_t cutoff) const
+    {
+        if(_size <= std::max<size_t>(cutoff, 2))
+            return calculateDeterminantLaplaceExpansion();
+
+        const auto [alongRows, biggestVector] = expansionVector();
+        std::vector<double> cofactors(_size, 0.);
+
+        TaskGroup group;
+        for(auto i = 0u; i < _size; i++)
+        {
+            const auto r = alongRows ? biggestVector : i;
+            const auto c = alongRows ? i : biggestVector;
+            if((*this)(r, c) == 0.)
+                continue;
+
+            pool.spawn(group, [this, &pool, &cofactors, cutoff, r, c, i](){
+                MATH_PROFILE_COUNT(cofactors, 1);
+
+                const auto detMinorRC = minor(r, c).calculateDeterminantLaplaceExpansion(pool, cutoff);
+                const auto sign = (r + c) % 2 == 0 ? 1 : -1;
+                cofactors[i] = sign * detMinorRC;
+            });
+        }
+
+        pool.wait(group);
+
+        double res = 0;
+        for(auto i = 0u; i < _size; i++)
+        {
+            auto v = alongRows ? (*this)(biggestVector, i) : (*this)(i, biggestVector);
+            if(v == 0.)
+                continue;
+
+            res += v * cofactors[i];
+        }
+
+        return res;
+    }
+
+private:
+    MatrixView(const double *data, size_t stride, size_t size)
+        : _data(data), _stride(stride), _size(size), _buffer(4 * size) {}
+
+    // define a row or column with biggest number of zero elements
+    std::pair<bool, size_t> expansionVector() const
+    {
+        auto [biggestRow, numZeroElemInRow] = calculateVectorWithBiggestNumberOfZeroElements<true>();
+        auto [biggestCol, numZeroElemInCol] = calculateVectorWithBiggestNumberOfZeroElements<false>();
+
+        bool alongRows = numZeroElemInRow >= numZeroElemInCol;
+        return {alongRows, alongRows ? biggestRow : biggestCol};
+    }
+
+    // one allocation per view: row indexes, column indexes, row zeros, column zeros
+    size_t *rowIndexes() { return _buffer.data(); }
+    size_t *colIndexes() { return _buffer.data() + _size; }
+    size_t *rowZeros() { return _buffer.data() + 2 * _size; }
+    size_t *colZeros() { return _buffer.data() + 3 * _size; }
+    const size_t *rowIndexes() const { return _buffer.data(); }
+    const size_t *colIndexes() const { return _buffer.data() + _size; }
+    const size_t *rowZeros() const { return _buffer.data() + 2 * _size; }
+    const size_t *colZeros() const { return _buffer.data() + 3 * _size; }
+
+    const double *_data = nullptr;
+    size_t _stride = 0;
+    size_t _size = 0;
+    std::vector<size_t> _buffer;
+};
+
+template<bool amongRows>
+inline std::pair<size_t, size_t> Matrix::calculateVectorWithBiggestNumberOfZeroElements() const
+{
+    return MatrixView(*this).calculateVectorWithBiggestNumberOfZeroElements<amongRows>();
+}
+
+inline MatrixView Matrix::minor(size_t r, size_t c) const
+{
+    return MatrixView(*this).minor(r, c);
+}
+
+inline double Matrix::algebraicСomplement(size_t r, size_t c) const
+{
+    return MatrixView(*this).algebraicСomplement(r, c);
+}
+
+inline double Matrix::calculateDeterminantLaplaceExpansion() const
+{
+    return MatrixView(*this).calculateDeterminantLaplaceExpansion();
+}
+
+inline double Matrix::calculateDeterminantLaplaceFixed() const
+{
+    // small matrices skip the view with its zero counts
+    if(isSquare() && _rows && _rows <= g_FixedMatrixMaxSize)
+        return calculateDeterminantFixed(_rows, *this);
+
+    return MatrixView(*this).calculateDeterminantLaplaceExpansion(true);
+}
+
+inline double Matrix::calculateDeterminantLaplaceParallel(size_t threads, size_t cutoff) const
+{
+    TaskPool pool(threads ? threads : std::thread::hardware_concurrency());
+    return MatrixView(*this).calculateDeterminantLaplaceExpansion(pool, cutoff);
+}
+
+// P A = L U by gaussian elimination with partial pivoting: L is unit lower and U upper
+// triangular, both in one row-major array, and row i of the factors is row _rowOf[i] of A.
+// One O(n^3) factorization answers the determinant, solves with any number of right hand
+// sides in O(n^2) each, the inverse and the log-determinant.
+// A column without a pivot leaves a zero on the diagonal of U, solves of a singular matrix throw.
+class Factorization {
+public:
+    Factorization() = default;
+
+    explicit Factorization(const Matrix &mtx)
+        : _lu(mtx._data), _rowOf(mtx.rows()), _size(mtx.rows())
+    {
+        if(!mtx.isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        const auto n = _size;
+        for(auto i = 0u; i < n; i++)
+            _rowOf[i] = i;
+
+        for(auto k = 0u; k < n; k++)
+        {
+            auto pivot = k;
+            for(auto i = k + 1; i < n; i++)
+                if(std::fabs(_lu[i * n + k]) > std::fabs(_lu[pivot * n + k]))
+                    pivot = i;
+
+            if(_lu[pivot * n + k] == 0.)
+                continue;
+
+            MATH_PROFILE_COUNT(pivots, 1);
+
+            if(pivot != k)
+            {
+                MATH_PROFILE_COUNT(rowSwaps, 1);
+
+                std::swap_ranges(_lu.begin() + pivot * n, _lu.begin() + (pivot + 1) * n, _lu.begin() + k * n);
+                std::swap(_rowOf[pivot], _rowOf[k]);
+                _sign = -_sign;
+            }
+
+            const auto akk = _lu[k * n + k];
+            for(auto i = k + 1; i < n; i++)
+            {
+                const auto factor = _lu[i * n + k] /= akk;
+                if(factor == 0.)
+                    continue;
+
+                for(auto j = k + 1; j < n; j++)
+                    _lu[i * n + j] -= factor * _lu[k * n + j];
+            }
+        }
+    }
+
+    size_t size() const { return _size; }
+
+    bool isSingular() const
+    {
+        for(auto k = 0u; k < _size; k++)
+            if(_lu[k * _size + k] == 0.)
+                return true;
+
+        return false;
+    }
+
+    // det = first * 2^second, so big matrices don't overflow on the way
+    std::pair<double, int> scaledDeterminant() const
+    {
+        double mantissa = _sign;
+        int exponent = 0;
+
+        for(auto k = 0u; k < _size; k++)
+        {
+            int e = 0;
+            mantissa = std::frexp(mantissa * _lu[k * _size + k], &e);
+            exponent += e;
+        }
+
+        return {mantissa, exponent};
+    }
+
+    double determinant() const
+    {
+        const auto [mantissa, exponent] = scaledDeterminant();
+        return std::ldexp(mantissa, exponent);
+    }
+
+    // sign and log|det| as numpy.linalg.slogdet, finite where det itself overflows;
+    // a singular matrix gives 0 and -inf
+    std::pair<double, double> slogdet() const
+    {
+        double sign = _sign;
+        double logAbs = 0.;
+
+        for(auto k = 0u; k < _size; k++)
+        {
+            const auto ukk = _lu[k * _size + k];
+            if(ukk == 0.)
+                return {0., -INFINITY};
+
+            if(ukk < 0.)
+                sign = -sign;
+
+            logAbs += std::log(std::fabs(ukk));
+        }
+
+        return {sign, logAbs};
+    }
+
+    // x with A x = b
+    Vector solve(const Vector &b) const
+    {
+        if(b.size() != _size)
+            throw std::runtime_error("Wrong right hand side size");
+
+        Vector x(_size);
+        for(auto i = 0u; i < _size; i++)
+            x[i] = b[_rowOf[i]];
+
+        solveRows(x._v.data(), 1);
+        return x;
+    }
+
+    // X with A X = B for all columns of B at once
+    Matrix solve(const Matrix &b) const
+    {
+        if(b.rows() != _size)
+            throw std::runtime_error("Wrong right hand side size");
+
+        const auto k = b.cols();
+        Matrix x(_size, k);
+        for(auto i = 0u; i < _size; i++)
+            std::copy(b.data() + _rowOf[i] * k, b.data() + (_rowOf[i] + 1) * k, x.data() + i * k);
+
+        solveRows(x.data(), k);
+        return x;
+    }
+
+    Matrix inverse() const
+    {
+        Matrix identity(_size, _size);
+        for(auto i = 0u; i < _size; i++)
+            identity(i, i) = 1.;
+
+        return solve(identity);
+    }
+
+    std::vector<double> _lu;
+    std::vector<size_t> _rowOf;
+    double _sign = 1.;
+    size_t _size = 0;
+
+private:
+    // L U X = B for the permuted rows of B, k right hand sides in every row
+    void solveRows(double *x, size_t k) const
+    {
+        if(isSingular())
+            throw std::runtime_error("Matrix is singular");
+
+        const auto n = _size;
+
+        for(auto i = 0u; i < n; i++)
+            for(auto j = 0u; j < i; j++)
+            {
+                const auto lij = _lu[i * n + j];
+                if(lij == 0.)
+                    continue;
+
+                for(auto c = 0u; c < k; c++)
+                    x[i * k + c] -= lij * x[j * k + c];
+            }
+
+        for(auto i = n; i-- > 0;)
+        {
+            for(auto j = i + 1; j < n; j++)
+            {
+                const auto uij = _lu[i * n + j];
+                if(uij == 0.)
+                    continue;
+
+                for(auto c = 0u; c < k; c++)
+                    x[i * k + c] -= uij * x[j * k + c];
+            }
+
+            const auto uii = _lu[i * n + i];
+            for(auto c = 0u; c < k; c++)
+                x[i * k + c] /= uii;
+        }
+    }
 };
 
+inline double Matrix::calculateDeterminantLU() const
+{
+    return factorize().determinant();
+}
+
+inline Factorization Matrix::factorize() const
+{
+    return Factorization(*this);
+}
+
 }
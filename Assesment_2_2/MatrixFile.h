@@ -0,0 +1,448 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MATH_HAS_MMAP 1
+#endif
+
+#include "Matrix.h"
+
+namespace math {
+
+#ifdef MATH_HAS_MMAP
+// whole pages of [offset, offset + bytes) of a mapping leave memory, the file keeps the data
+inline void releasePages(void *mapping, size_t size, size_t offset, size_t bytes)
+{
+    const auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const auto first = (offset + page - 1) / page * page;
+    const auto last = std::min(size, offset + bytes) / page * page;
+
+    if(mapping && first < last)
+        ::madvise(static_cast<char *>(mapping) + first, last - first, MADV_DONTNEED);
+}
+#endif
+
+// whole file for reading, memory mapped where the platform allows it
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path)
+    {
+#ifdef MATH_HAS_MMAP
+        const auto fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("Failed to open the file " + path);
+
+        struct stat info;
+        if(::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to read the file " + path);
+        }
+
+        _size = static_cast<size_t>(info.st_size);
+        if(_size)
+        {
+            _mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(_mapping == MAP_FAILED)
+            {
+                _mapping = nullptr;
+                ::close(fd);
+                throw std::runtime_error("Failed to map the file " + path);
+            }
+
+            ::madvise(_mapping, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const char *>(_mapping);
+        }
+
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if(!file.is_open())
+            throw std::runtime_error("Failed to open the file " + path);
+
+        _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        _data = _buffer.data();
+        _size = _buffer.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef MATH_HAS_MMAP
+        if(_mapping)
+            ::munmap(_mapping, _size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+
+    // the range was read and is not needed again
+    void doneWith(size_t offset, size_t bytes)
+    {
+#ifdef MATH_HAS_MMAP
+        releasePages(_mapping, _size, offset, bytes);
+#else
+        (void)offset;
+        (void)bytes;
+#endif
+    }
+
+private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+    void *_mapping = nullptr;
+    std::vector<char> _buffer;
+};
+
+// Binary matrix: this header and then rows * cols doubles row by row, exactly the storage
+// of Matrix in host byte order, so loading is one copy from the mapped file
+struct BinaryMatrixHeader {
+    char _magic[8];
+    uint64_t _rows;
+    uint64_t _cols;
+};
+
+const static char g_BinaryMatrixMagic[8] = {'M', 'F', 'A', 'M', 'T', 'X', '0', '1'};
+
+inline bool isBinaryMatrix(const char *data, size_t size)
+{
+    return size >= sizeof(g_BinaryMatrixMagic) && !std::memcmp(data, g_BinaryMatrixMagic, sizeof(g_BinaryMatrixMagic));
+}
+
+inline Matrix parseMatrixBinary(const char *data, size_t size)
+{
+    BinaryMatrixHeader header;
+    if(size < sizeof(header) || !isBinaryMatrix(data, size))
+        throw std::runtime_error("Wrong binary matrix header");
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if(!header._rows || !header._cols)
+        return Matrix();
+
+    if((size - sizeof(header)) / sizeof(double) / header._cols != header._rows
+       || size - sizeof(header) != header._rows * header._cols * sizeof(double))
+        throw std::runtime_error("Wrong binary matrix size");
+
+    Matrix mtx(header._rows, header._cols);
+    std::memcpy(mtx.data(), data + sizeof(header), header._rows * header._cols * sizeof(double));
+    return mtx;
+}
+
+inline void writeMatrixBinary(const Matrix &mtx, const std::string &path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+        throw std::runtime_error("Failed to open the file " + path);
+
+    BinaryMatrixHeader header;
+    std::memcpy(header._magic, g_BinaryMatrixMagic, sizeof(header._magic));
+    header._rows = mtx.rows();
+    header._cols = mtx.cols();
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(mtx.data()), mtx.rows() * mtx.cols() * sizeof(double));
+
+    if(!file)
+        throw std::runtime_error("Failed to write the file " + path);
+}
+
+// Text matrix: one row per line, numbers separated by spaces or tabs, blank lines are skipped.
+// The text is cut into chunks at line ends. Numbers per line are counted in parallel first,
+// so every chunk knows its offset and the second parallel pass parses with from_chars
+// straight into the contiguous storage of the matrix.
+// Integers, when given, get an exact copy of an all-integer matrix and stay empty otherwise.
+// Zeros are counted along with numbers, and when sparse is given and the matrix is big and
+// sparse enough it is parsed straight into it instead, the returned dense matrix is empty then
+// while integers still get the exact copy.
+inline Matrix parseMatrixText(const char *begin, const char *end, TaskPool &pool,
+                              IntegerMatrix *integers = nullptr, SparseMatrix *sparse = nullptr,
+                              size_t chunkBytes = 1 << 20)
+{
+    auto isSpace = [](char c){ return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; };
+
+    // 0, -0, 0.00, +0e5 and alike
+    auto isZero = [](const char *p, const char *last){
+        if(p < last && (*p == '+' || *p == '-'))
+            p++;
+
+        bool hasDigit = false;
+        for(; p < last && (*p == '0' || *p == '.'); p++)
+            hasDigit = hasDigit || *p == '0';
+
+        return hasDigit && (p == last || *p == 'e' || *p == 'E');
+    };
+
+    auto parseNumber = [](const char *p, const char *last, double &value, int64_t &integer){
+        const auto first = *p == '+' && last - p > 1 ? p + 1 : p;
+
+        const auto [integerEnd, integerError] = std::from_chars(first, last, integer);
+        if(integerError == std::errc() && integerEnd == last)
+        {
+            value = static_cast<double>(integer);
+            return true;
+        }
+
+        const auto [valueEnd, valueError] = std::from_chars(first, last, value);
+        if(valueError != std::errc() || valueEnd != last)
+            throw std::runtime_error("Wrong number: " + std::string(p, last));
+
+        return false;
+    };
+
+    struct Chunk {
+        const char *_begin = nullptr;
+        const char *_end = nullptr;
+        std::vector<size_t> _lineCounts;
+        size_t _zeros = 0;
+        size_t _offset = 0;
+        size_t _firstRow = 0;
+        bool _isInteger = true;
+        std::vector<SparseMatrix::Triplet> _triplets;
+        std::vector<int64_t> _exactValues;
+    };
+
+    std::vector<Chunk> chunks;
+    chunkBytes = std::max<size_t>(chunkBytes, 1);
+
+    for(auto p = begin; p < end;)
+    {
+        auto last = p + std::min<size_t>(chunkBytes, end - p);
+        last = std::find(last, end, '\n');
+        if(last != end)
+            last++;
+
+        Chunk chunk;
+        chunk._begin = p;
+        chunk._end = last;
+        chunks.push_back(std::move(chunk));
+        p = last;
+    }
+
+    TaskGroup group;
+    for(auto &chunk : chunks)
+        pool.spawn(group, [&chunk, isSpace, isZero](){
+            size_t count = 0;
+            const char *token = nullptr;
+
+            for(auto p = chunk._begin; p <= chunk._end; p++)
+            {
+                const auto isSeparator = p == chunk._end || *p == '\n' || isSpace(*p);
+
+                if(isSeparator && token)
+                {
+                    if(isZero(token, p))
+                        chunk._zeros++;
+
+                    token = nullptr;
+                }
+                else if(!isSeparator && !token)
+                {
+                    token = p;
+                    count++;
+                }
+
+                if((p == chunk._end || *p == '\n') && count)
+                {
+                    chunk._lineCounts.push_back(count);
+                    count = 0;
+                }
+            }
+        });
+
+    pool.wait(group);
+
+    size_t rows = 0;
+    size_t cols = 0;
+    size_t zeros = 0;
+    for(auto &chunk : chunks)
+    {
+        chunk._offset = rows * cols;
+        chunk._firstRow = rows;
+        zeros += chunk._zeros;
+
+        for(auto count : chunk._lineCounts)
+        {
+            if(rows && count != cols)
+                throw std::runtime_error("Numbers of columns is defferent");
+
+            cols = count;
+            rows++;
+        }
+    }
+
+    if(integers)
+        integers->clear();
+
+    if(sparse)
+        *sparse = SparseMatrix();
+
+    if(!rows)
+        return Matrix();
+
+    const auto density = 1. - static_cast<double>(zeros) / rows / cols;
+    if(sparse && std::min(rows, cols) >= SparseMatrix::s_SparseMinSize && density <= SparseMatrix::s_SparseDensity)
+    {
+        for(auto &chunk : chunks)
+            pool.spawn(group, [&chunk, isSpace, parseNumber, exact = integers != nullptr](){
+                auto row = chunk._firstRow;
+                size_t col = 0;
+
+                for(auto p = chunk._begin; p < chunk._end;)
+                {
+                    if(*p == '\n')
+                    {
+                        if(col)
+                            row++;
+
+                        col = 0;
+                        p++;
+                        continue;
+                    }
+
+                    if(isSpace(*p))
+                    {
+                        p++;
+                        continue;
+                    }
+
+                    auto last = p;
+                    while(last < chunk._end && !isSpace(*last) && *last != '\n')
+                        last++;
+
+                    double value = 0.;
+                    int64_t integer = 0;
+                    if(!parseNumber(p, last, value, integer))
+                        chunk._isInteger = false;
+
+                    if(value != 0.)
+                    {
+                        chunk._triplets.push_back({row, col, value});
+                        if(exact && chunk._isInteger)
+                            chunk._exactValues.push_back(integer);
+                    }
+
+                    col++;
+                    p = last;
+                }
+            });
+
+        pool.wait(group);
+
+        // the exact copy is dense, as Bareiss and modular elimination are, so it is kept for small matrices only
+        // and sparse input scales with its nonzeros
+        if(integers && rows <= Matrix::s_ExactMaxSize && std::all_of(chunks.begin(), chunks.end(), [](const Chunk &chunk){ return chunk._isInteger; }))
+        {
+            integers->_data.assign(rows * cols, 0);
+            integers->_rows = rows;
+            integers->_cols = cols;
+
+            for(const auto &chunk : chunks)
+                for(size_t i = 0; i < chunk._triplets.size(); i++)
+                    integers->_data[chunk._triplets[i]._row * cols + chunk._triplets[i]._col] = chunk._exactValues[i];
+        }
+
+        std::vector<SparseMatrix::Triplet> triplets;
+        for(auto &chunk : chunks)
+        {
+            triplets.insert(triplets.end(), chunk._triplets.begin(), chunk._triplets.end());
+            chunk._triplets = {};
+            chunk._exactValues = {};
+        }
+
+        *sparse = SparseMatrix::fromTriplets(rows, cols, std::move(triplets));
+        return Matrix();
+    }
+
+    Matrix mtx(rows, cols);
+    std::vector<int64_t> exactValues(integers ? rows * cols : 0);
+
+    double *values = mtx.data();
+    int64_t *exact = exactValues.data();
+
+    for(auto &chunk : chunks)
+        pool.spawn(group, [&chunk, values, exact, isSpace, parseNumber](){
+            auto position = chunk._offset;
+
+            for(auto p = chunk._begin; p < chunk._end;)
+            {
+                if(isSpace(*p) || *p == '\n')
+                {
+                    p++;
+                    continue;
+                }
+
+                auto last = p;
+                while(last < chunk._end && !isSpace(*last) && *last != '\n')
+                    last++;
+
+                int64_t integer = 0;
+                if(!parseNumber(p, last, values[position], integer))
+                    chunk._isInteger = false;
+                else if(exact)
+                    exact[position] = integer;
+
+                position++;
+                p = last;
+            }
+        });
+
+    pool.wait(group);
+
+    if(integers && std::all_of(chunks.begin(), chunks.end(), [](const Chunk &chunk){ return chunk._isInteger; }))
+    {
+        integers->_data = std::move(exactValues);
+        integers->_rows = rows;
+        integers->_cols = cols;
+    }
+
+    return mtx;
+}
+
+// binary or text matrix file by its first bytes
+inline Matrix readMatrixFile(const std::string &path, TaskPool &pool,
+                             IntegerMatrix *integers = nullptr, SparseMatrix *sparse = nullptr)
+{
+    MappedFile file(path);
+
+    if(isBinaryMatrix(file.data(), file.size()))
+    {
+        auto mtx = parseMatrixBinary(file.data(), file.size());
+        if(integers)
+            mtx.toIntegers(*integers);
+
+        if(sparse)
+        {
+            *sparse = SparseMatrix();
+            if(std::min(mtx.rows(), mtx.cols()) >= SparseMatrix::s_SparseMinSize && mtx.density() <= SparseMatrix::s_SparseDensity)
+            {
+                if(integers && mtx.rows() > Matrix::s_ExactMaxSize)
+                    integers->clear();
+
+                *sparse = mtx.toSparse();
+                return Matrix();
+            }
+        }
+
+        return mtx;
+    }
+
+    return parseMatrixText(file.data(), file.data() + file.size(), pool, integers, sparse);
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace math {
+
+// arithmetic modulo odd p < 2^62 in Montgomery form with R = 2^64,
+// so multiplication needs no 128-bit division
+class Montgomery {
+public:
+    explicit Montgomery(uint64_t p)
+        : _p(p)
+    {
+        // Newton iteration for p^-1 mod 2^64, every step doubles the correct bits
+        uint64_t inverse = p;
+        for(auto i = 0; i < 5; i++)
+            inverse *= 2 - p * inverse;
+
+        _negativeInverse = -inverse;
+
+        const uint64_t r = (0 - p) % p;
+        _r2 = static_cast<uint64_t>(static_cast<unsigned __int128>(r) * r % p);
+        _one = r;
+    }
+
+    uint64_t modulus() const { return _p; }
+    uint64_t one() const { return _one; }
+
+    uint64_t reduce(unsigned __int128 t) const
+    {
+        const uint64_t m = static_cast<uint64_t>(t) * _negativeInverse;
+        const uint64_t res = static_cast<uint64_t>((t + static_cast<unsigned __int128>(m) * _p) >> 64);
+        return res >= _p ? res - _p : res;
+    }
+
+    uint64_t toMontgomery(int64_t v) const
+    {
+        const auto magnitude = static_cast<uint64_t>(v < 0 ? -static_cast<__int128>(v) : v) % _p;
+        const auto res = v < 0 && magnitude ? _p - magnitude : magnitude;
+        return multiply(res, _r2);
+    }
+
+    uint64_t fromMontgomery(uint64_t a) const { return reduce(a); }
+
+    uint64_t multiply(uint64_t a, uint64_t b) const
+    {
+        return reduce(static_cast<unsigned __int128>(a) * b);
+    }
+
+    uint64_t add(uint64_t a, uint64_t b) const
+    {
+        const auto res = a + b;
+        return res >= _p ? res - _p : res;
+    }
+
+    uint64_t subtract(uint64_t a, uint64_t b) const
+    {
+        return a >= b ? a - b : a + _p - b;
+    }
+
+    uint64_t power(uint64_t a, uint64_t e) const
+    {
+        uint64_t res = _one;
+        while(e)
+        {
+            if(e & 1)
+                res = multiply(res, a);
+
+            a = multiply(a, a);
+            e >>= 1;
+        }
+
+        return res;
+    }
+
+    // p is prime, so a^-1 = a^(p - 2)
+    uint64_t inverse(uint64_t a) const { return power(a, _p - 2); }
+
+private:
+    uint64_t _p;
+    uint64_t _negativeInverse;
+    uint64_t _r2;
+    uint64_t _one;
+};
+
+inline uint64_t multiplyModulo(uint64_t a, uint64_t b, uint64_t m)
+{
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b % m);
+}
+
+inline uint64_t powerModulo(uint64_t a, uint64_t e, uint64_t m)
+{
+    uint64_t res = 1 % m;
+    while(e)
+    {
+        if(e & 1)
+            res = multiplyModulo(res, a, m);
+
+        a = multiplyModulo(a, a, m);
+        e >>= 1;
+    }
+
+    return res;
+}
+
+// Miller-Rabin, these bases are deterministic for every 64-bit number
+inline bool isPrime(uint64_t n)
+{
+    if(n < 2)
+        return false;
+
+    static const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    for(auto b : bases)
+        if(n % b == 0)
+            return n == b;
+
+    auto d = n - 1;
+    auto s = 0;
+    while(!(d & 1))
+    {
+        d >>= 1;
+        s++;
+    }
+
+    for(auto b : bases)
+    {
+        auto x = powerModulo(b, d, n);
+        if(x == 1 || x == n - 1)
+            continue;
+
+        auto isComposite = true;
+        for(auto r = 1; r < s && isComposite; r++)
+        {
+            x = multiplyModulo(x, x, n);
+            isComposite = x != n - 1;
+        }
+
+        if(isComposite)
+            return false;
+    }
+
+    return true;
+}
+
+// the largest primes below 2^62, every one of them is above 2^61
+inline std::vector<uint64_t> largePrimes(size_t count)
+{
+    std::vector<uint64_t> res;
+    res.reserve(count);
+
+    for(uint64_t candidate = (uint64_t(1) << 62) - 1; res.size() < count; candidate -= 2)
+        if(isPrime(candidate))
+            res.push_back(candidate);
+
+    return res;
+}
+
+}
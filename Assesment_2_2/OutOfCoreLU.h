@@ -0,0 +1,397 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MatrixFile.h"
+
+namespace math {
+
+// Read-write file of doubles, memory mapped where the platform allows it
+class MappedTileFile {
+public:
+    // creates the file with the given size when it is not 0
+    MappedTileFile(const std::string &path, size_t size = 0)
+    {
+#ifdef MATH_HAS_MMAP
+        const auto fd = ::open(path.c_str(), size ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+        if(fd < 0)
+            throw std::runtime_error("Failed to open the file " + path);
+
+        struct stat info;
+        if(size ? ::ftruncate(fd, static_cast<off_t>(size)) != 0 : ::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to size the file " + path);
+        }
+
+        _size = size ? size : static_cast<size_t>(info.st_size);
+        if(_size)
+        {
+            _mapping = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(_mapping == MAP_FAILED)
+            {
+                _mapping = nullptr;
+                ::close(fd);
+                throw std::runtime_error("Failed to map the file " + path);
+            }
+        }
+
+        ::close(fd);
+#else
+        if(size)
+            std::ofstream(path, std::ios::binary | std::ios::trunc).seekp(size - 1).put(0);
+
+        _file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if(!_file.is_open())
+            throw std::runtime_error("Failed to open the file " + path);
+
+        _file.seekg(0, std::ios::end);
+        _size = static_cast<size_t>(_file.tellg());
+#endif
+    }
+
+    ~MappedTileFile()
+    {
+#ifdef MATH_HAS_MMAP
+        if(_mapping)
+            ::munmap(_mapping, _size);
+#endif
+    }
+
+    MappedTileFile(const MappedTileFile &) = delete;
+    MappedTileFile &operator=(const MappedTileFile &) = delete;
+
+    size_t size() const { return _size; }
+
+    void read(size_t offset, void *data, size_t bytes)
+    {
+        check(offset, bytes);
+#ifdef MATH_HAS_MMAP
+        std::memcpy(data, static_cast<const char *>(_mapping) + offset, bytes);
+#else
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.seekg(offset);
+        _file.read(static_cast<char *>(data), bytes);
+#endif
+    }
+
+    void write(size_t offset, const void *data, size_t bytes)
+    {
+        check(offset, bytes);
+#ifdef MATH_HAS_MMAP
+        std::memcpy(static_cast<char *>(_mapping) + offset, data, bytes);
+#else
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.seekp(offset);
+        _file.write(static_cast<const char *>(data), bytes);
+#endif
+    }
+
+    // the pages are going to be read soon
+    void willNeed(size_t offset, size_t bytes)
+    {
+#ifdef MATH_HAS_MMAP
+        const auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const auto first = offset / page * page;
+        if(first < _size)
+            ::madvise(static_cast<char *>(_mapping) + first, std::min(_size, offset + bytes) - first, MADV_WILLNEED);
+#else
+        (void)offset;
+        (void)bytes;
+#endif
+    }
+
+    // the range is not needed for a while, written data stays in the file
+    void doneWith(size_t offset, size_t bytes)
+    {
+#ifdef MATH_HAS_MMAP
+        releasePages(_mapping, _size, offset, bytes);
+#else
+        (void)offset;
+        (void)bytes;
+#endif
+    }
+
+private:
+    void check(size_t offset, size_t bytes) const
+    {
+        if(offset > _size || bytes > _size - offset)
+            throw std::runtime_error("Tile file access is out of range");
+    }
+
+    size_t _size = 0;
+#ifdef MATH_HAS_MMAP
+    void *_mapping = nullptr;
+#else
+    std::fstream _file;
+    std::mutex _mutex;
+#endif
+};
+
+// Tile file: this header and then the columns of tiles left to right, a column of tiles is
+// n rows of tileSize doubles (fewer in the last one) row by row, so any tile, and any
+// range of rows of a column, is one contiguous range of the file.
+struct TileMatrixHeader {
+    char _magic[8];
+    uint64_t _size;
+    uint64_t _tileSize;
+};
+
+const static char g_TileMatrixMagic[8] = {'M', 'F', 'A', 'T', 'I', 'L', '0', '1'};
+
+// Determinant of a matrix which doesn't fit in memory. The matrix is copied into a tile
+// file and factorized there by left-looking LU with partial pivoting over columns of tiles:
+// a column is read in, the row swaps and the L columns to its left are applied to it, it is
+// factorized and written back. The next L column is read by another thread while the
+// current one is applied. Memory is three columns of tiles, so tileSize is chosen to fit
+// the budget; besides them only the row swaps (n indexes), the sign and log|det| stay.
+class OutOfCoreLU {
+public:
+    static constexpr size_t s_DefaultBudget = size_t(256) << 20;
+
+    // widest tile with three n x tileSize columns of doubles in the budget
+    static size_t tileSizeFor(size_t n, size_t memoryBudget)
+    {
+        return std::clamp<size_t>(memoryBudget / (3 * n * sizeof(double)), 1, std::max<size_t>(n, 1));
+    }
+
+    static void writeTiles(const Matrix &mtx, const std::string &path, size_t tileSize)
+    {
+        if(mtx.isEmpty() || !mtx.isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        writeTiles(mtx.data(), mtx.rows(), path, tileSize);
+    }
+
+    // from a binary matrix file, streamed row by row through the mapping,
+    // with the tile size for the budget
+    static void writeTilesFromBinary(const std::string &binaryPath, const std::string &path, size_t memoryBudget)
+    {
+        MappedFile source(binaryPath);
+
+        BinaryMatrixHeader header;
+        if(source.size() < sizeof(header) || !isBinaryMatrix(source.data(), source.size()))
+            throw std::runtime_error("Out-of-core determinant needs a binary matrix file, convert it with --write-binary");
+
+        std::memcpy(&header, source.data(), sizeof(header));
+        if(!header._rows || header._rows != header._cols)
+            throw std::runtime_error("Matrix should be square");
+
+        if((source.size() - sizeof(header)) / sizeof(double) / header._rows != header._rows
+           || source.size() - sizeof(header) != header._rows * header._rows * sizeof(double))
+            throw std::runtime_error("Wrong binary matrix size");
+
+        const auto n = static_cast<size_t>(header._rows);
+        writeTiles(reinterpret_cast<const double *>(source.data() + sizeof(header)), n, path, tileSizeFor(n, memoryBudget), &source);
+    }
+
+    // sign and log|det| of the tile file, which is overwritten by the factors
+    static std::pair<double, double> slogdet(const std::string &path, size_t memoryBudget = s_DefaultBudget)
+    {
+        MappedTileFile file(path);
+
+        TileMatrixHeader header;
+        if(file.size() < sizeof(header))
+            throw std::runtime_error("Wrong tile file header");
+
+        file.read(0, &header, sizeof(header));
+        if(std::memcmp(header._magic, g_TileMatrixMagic, sizeof(header._magic)) || !header._size || !header._tileSize)
+            throw std::runtime_error("Wrong tile file header");
+
+        const auto n = static_cast<size_t>(header._size);
+        const auto tileSize = static_cast<size_t>(header._tileSize);
+        if(file.size() != sizeof(header) + n * n * sizeof(double))
+            throw std::runtime_error("Wrong tile file size");
+
+        if(3 * n * tileSize * sizeof(double) > std::max(memoryBudget, 3 * n * sizeof(double)))
+            throw std::runtime_error("Tiles of the file don't fit the memory budget");
+
+        const auto columns = (n + tileSize - 1) / tileSize;
+        auto first = [&](size_t p){ return p * tileSize; };
+        auto width = [&](size_t p){ return std::min(tileSize, n - p * tileSize); };
+        auto offset = [&](size_t p, size_t row){ return sizeof(header) + (n * first(p) + row * width(p)) * sizeof(double); };
+
+        std::vector<size_t> swaps(n);
+        std::vector<double> panel(n * tileSize);
+        std::vector<double> current(n * tileSize), next(n * tileSize);
+
+        double sign = 1.;
+        double logAbs = 0.;
+
+        // rows from the diagonal tile down of L column j, with the swaps up to column m applied
+        auto loadL = [&](size_t j, size_t m, std::vector<double> &l){
+            const auto w = width(j);
+            const auto top = first(j);
+            file.read(offset(j, top), l.data(), (n - top) * w * sizeof(double));
+            file.doneWith(offset(j, top), (n - top) * w * sizeof(double));
+
+            for(auto k = top + w; k < first(m); k++)
+                if(swaps[k] != k)
+                    std::swap_ranges(l.begin() + (k - top) * w, l.begin() + (k - top + 1) * w, l.begin() + (swaps[k] - top) * w);
+        };
+
+        for(size_t m = 0; m < columns; m++)
+        {
+            const auto w = width(m);
+            const auto c0 = first(m);
+
+            if(m + 1 < columns)
+                file.willNeed(offset(m + 1, 0), n * width(m + 1) * sizeof(double));
+
+            std::future<void> prefetch;
+            if(m > 0)
+                prefetch = std::async(std::launch::async, loadL, 0, m, std::ref(next));
+
+            file.read(offset(m, 0), panel.data(), n * w * sizeof(double));
+
+            for(size_t k = 0; k < c0; k++)
+                if(swaps[k] != k)
+                    std::swap_ranges(panel.begin() + k * w, panel.begin() + (k + 1) * w, panel.begin() + swaps[k] * w);
+
+            // A(:, m) -= L(:, j) U(j, m) for every column of tiles on the left
+            for(size_t j = 0; j < m; j++)
+            {
+                prefetch.get();
+                std::swap(current, next);
+
+                if(j + 1 < m)
+                    prefetch = std::async(std::launch::async, loadL, j + 1, m, std::ref(next));
+
+                const auto wj = width(j);
+                const auto top = first(j);
+                const double *l = current.data();
+
+                // U(j, m) = L(j, j)^-1 A(j, m)
+                for(auto r = 0u; r < wj; r++)
+                    for(auto t = 0u; t < r; t++)
+                    {
+                        const auto factor = l[r * wj + t];
+                        if(factor == 0.)
+                            continue;
+
+                        for(auto c = 0u; c < w; c++)
+                            panel[(top + r) * w + c] -= factor * panel[(top + t) * w + c];
+                    }
+
+                for(auto i = top + wj; i < n; i++)
+                {
+                    double *row = &panel[i * w];
+                    for(auto t = 0u; t < wj; t++)
+                    {
+                        const auto factor = l[(i - top) * wj + t];
+                        if(factor == 0.)
+                            continue;
+
+                        const double *u = &panel[(top + t) * w];
+                        for(auto c = 0u; c < w; c++)
+                            row[c] -= factor * u[c];
+                    }
+                }
+            }
+
+            // the diagonal tile and the rows below it with partial pivoting
+            for(auto t = 0u; t < w; t++)
+            {
+                const auto k = c0 + t;
+                auto pivot = k;
+                for(auto i = k + 1; i < n; i++)
+                    if(std::fabs(panel[i * w + t]) > std::fabs(panel[pivot * w + t]))
+                        pivot = i;
+
+                const auto akk = panel[pivot * w + t];
+                if(akk == 0.)
+                    return {0., -INFINITY};
+
+                swaps[k] = pivot;
+                if(pivot != k)
+                {
+                    std::swap_ranges(panel.begin() + k * w, panel.begin() + (k + 1) * w, panel.begin() + pivot * w);
+                    sign = -sign;
+                }
+
+                if(akk < 0.)
+                    sign = -sign;
+
+                logAbs += std::log(std::fabs(akk));
+
+                for(auto i = k + 1; i < n; i++)
+                {
+                    const auto factor = panel[i * w + t] /= akk;
+                    if(factor == 0.)
+                        continue;
+
+                    for(auto c = t + 1; c < w; c++)
+                        panel[i * w + c] -= factor * panel[k * w + c];
+                }
+            }
+
+            file.write(offset(m, 0), panel.data(), n * w * sizeof(double));
+            file.doneWith(offset(m, 0), n * w * sizeof(double));
+        }
+
+        return {sign, logAbs};
+    }
+
+    // binary matrix file through a temporary tile file, which is removed after
+    static std::pair<double, double> slogdet(const std::string &binaryPath, const std::string &tilePath, size_t memoryBudget)
+    {
+        writeTilesFromBinary(binaryPath, tilePath, memoryBudget);
+
+        try {
+            const auto res = slogdet(tilePath, memoryBudget);
+            std::remove(tilePath.c_str());
+            return res;
+        }
+        catch(...)
+        {
+            std::remove(tilePath.c_str());
+            throw;
+        }
+    }
+
+private:
+    // a band of tileSize rows at a time, the pages of the band leave memory after it
+    static void writeTiles(const double *data, size_t n, const std::string &path, size_t tileSize,
+                           MappedFile *source = nullptr)
+    {
+        tileSize = std::clamp<size_t>(tileSize, 1, n);
+
+        TileMatrixHeader header;
+        std::memcpy(header._magic, g_TileMatrixMagic, sizeof(header._magic));
+        header._size = n;
+        header._tileSize = tileSize;
+
+        MappedTileFile file(path, sizeof(header) + n * n * sizeof(double));
+        file.write(0, &header, sizeof(header));
+
+        for(size_t r0 = 0; r0 < n; r0 += tileSize)
+        {
+            const auto r1 = std::min(n, r0 + tileSize);
+
+            for(size_t c0 = 0; c0 < n; c0 += tileSize)
+            {
+                const auto w = std::min(tileSize, n - c0);
+                const auto offset = sizeof(header) + (n * c0 + r0 * w) * sizeof(double);
+
+                for(auto r = r0; r < r1; r++)
+                    file.write(offset + (r - r0) * w * sizeof(double), data + r * n + c0, w * sizeof(double));
+
+                file.doneWith(offset, (r1 - r0) * w * sizeof(double));
+            }
+
+            if(source)
+                source->doneWith(sizeof(BinaryMatrixHeader) + r0 * n * sizeof(double), (r1 - r0) * n * sizeof(double));
+        }
+    }
+};
+
+}
@@ -0,0 +1,435 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Profile.h"
+
+namespace math {
+
+// Compressed sparse columns: row indexes and values of column c are at
+// [_colPointers[c], _colPointers[c + 1]) of _rowIndexes and _values, sorted by row.
+// Storage and the LU determinant scale with the number of nonzeros instead of n^2.
+class SparseMatrix {
+public:
+    struct Triplet {
+        size_t _row;
+        size_t _col;
+        double _value;
+    };
+
+    // below this share of nonzeros a big matrix is read and computed as sparse
+    static constexpr double s_SparseDensity = 0.1;
+    static constexpr size_t s_SparseMinSize = 64;
+
+    SparseMatrix() = default;
+
+    // duplicates are summed, zeros are dropped
+    static SparseMatrix fromTriplets(size_t rows, size_t cols, std::vector<Triplet> triplets)
+    {
+        std::sort(triplets.begin(), triplets.end(), [](const Triplet &a, const Triplet &b){
+            return a._col != b._col ? a._col < b._col : a._row < b._row;
+        });
+
+        SparseMatrix res;
+        res._rows = rows;
+        res._cols = cols;
+        res._colPointers.assign(cols + 1, 0);
+
+        for(auto i = 0u; i < triplets.size();)
+        {
+            const auto &t = triplets[i];
+            if(t._row >= rows || t._col >= cols)
+                throw std::runtime_error("Sparse matrix index is out of range");
+
+            double value = 0.;
+            auto j = i;
+            for(; j < triplets.size() && triplets[j]._row == t._row && triplets[j]._col == t._col; j++)
+                value += triplets[j]._value;
+
+            if(value != 0.)
+            {
+                res._rowIndexes.push_back(t._row);
+                res._values.push_back(value);
+                res._colPointers[t._col + 1]++;
+            }
+
+            i = j;
+        }
+
+        for(auto c = 0u; c < cols; c++)
+            res._colPointers[c + 1] += res._colPointers[c];
+
+        return res;
+    }
+
+    // from row-major dense storage
+    static SparseMatrix fromDense(const double *data, size_t rows, size_t cols)
+    {
+        SparseMatrix res;
+        res._rows = rows;
+        res._cols = cols;
+        res._colPointers.assign(cols + 1, 0);
+
+        for(auto c = 0u; c < cols; c++)
+        {
+            for(auto r = 0u; r < rows; r++)
+            {
+                const auto v = data[r * cols + c];
+                if(v == 0.)
+                    continue;
+
+                res._rowIndexes.push_back(r);
+                res._values.push_back(v);
+            }
+
+            res._colPointers[c + 1] = res._rowIndexes.size();
+        }
+
+        return res;
+    }
+
+    // to row-major dense storage
+    void toDense(double *data) const
+    {
+        std::fill(data, data + _rows * _cols, 0.);
+        for(auto c = 0u; c < _cols; c++)
+            for(auto p = _colPointers[c]; p < _colPointers[c + 1]; p++)
+                data[_rowIndexes[p] * _cols + c] = _values[p];
+    }
+
+    bool isEmpty() const { return !_rows; }
+    bool isSquare() const { return _rows == _cols; }
+
+    size_t rows() const { return _rows; }
+    size_t cols() const { return _cols; }
+    size_t nonZeros() const { return _values.size(); }
+
+    double density() const
+    {
+        return _rows && _cols ? static_cast<double>(nonZeros()) / _rows / _cols : 0.;
+    }
+
+    double operator()(size_t r, size_t c) const
+    {
+        const auto first = _rowIndexes.begin() + _colPointers[c];
+        const auto last = _rowIndexes.begin() + _colPointers[c + 1];
+        const auto it = std::lower_bound(first, last, r);
+
+        return it != last && *it == r ? _values[it - _rowIndexes.begin()] : 0.;
+    }
+
+    // Approximate minimum degree on the pattern of A^T A, whose fill bounds the fill of LU with
+    // any row pivoting, as COLAMD does. Rows denser than 10 sqrt(n) would make the graph dense and
+    // are left out. Eliminated columns become elements of a quotient graph instead of cliques, and
+    // degrees are bounded with element sizes outside the new element as in AMD.
+    std::vector<size_t> minimumDegreeOrdering() const
+    {
+        const auto n = _cols;
+        const auto denseRow = std::max<size_t>(16, static_cast<size_t>(10 * std::sqrt(static_cast<double>(n))));
+
+        std::vector<std::vector<size_t>> rowCols(_rows);
+        for(auto c = 0u; c < n; c++)
+            for(auto p = _colPointers[c]; p < _colPointers[c + 1]; p++)
+                rowCols[_rowIndexes[p]].push_back(c);
+
+        std::vector<std::vector<size_t>> adjacent(n);
+        for(const auto &cols : rowCols)
+        {
+            if(cols.size() > denseRow)
+                continue;
+
+            for(auto a : cols)
+                for(auto b : cols)
+                    if(a != b)
+                        adjacent[a].push_back(b);
+        }
+
+        rowCols = {};
+
+        std::set<std::pair<size_t, size_t>> queue;
+        std::vector<size_t> degree(n);
+        for(auto c = 0u; c < n; c++)
+        {
+            std::sort(adjacent[c].begin(), adjacent[c].end());
+            adjacent[c].erase(std::unique(adjacent[c].begin(), adjacent[c].end()), adjacent[c].end());
+
+            degree[c] = adjacent[c].size();
+            queue.insert({degree[c], c});
+        }
+
+        // element e is eliminated column e with its variables, elementsOf[i] are elements of variable i
+        std::vector<std::vector<size_t>> elements(n);
+        std::vector<std::vector<size_t>> elementsOf(n);
+        std::vector<char> isEliminated(n, 0);
+        std::vector<char> isAbsorbed(n, 0);
+
+        std::vector<size_t> mark(n, 0);
+        std::vector<long long> outside(n, -1);
+        std::vector<size_t> touched;
+
+        std::vector<size_t> order;
+        order.reserve(n);
+
+        for(size_t k = 1; !queue.empty(); k++)
+        {
+            const auto p = queue.begin()->second;
+            queue.erase(queue.begin());
+            order.push_back(p);
+            isEliminated[p] = 1;
+
+            // variables of the new element p, the elements of p are absorbed into it
+            auto &lp = elements[p];
+            mark[p] = k;
+
+            auto add = [&](size_t i){
+                if(isEliminated[i] || mark[i] == k)
+                    return;
+
+                mark[i] = k;
+                lp.push_back(i);
+            };
+
+            for(auto i : adjacent[p])
+                add(i);
+
+            for(auto e : elementsOf[p])
+            {
+                if(isAbsorbed[e])
+                    continue;
+
+                for(auto i : elements[e])
+                    add(i);
+
+                isAbsorbed[e] = 1;
+                elements[e] = {};
+            }
+
+            adjacent[p] = {};
+            elementsOf[p] = {};
+
+            // |Le \ Lp| for every element met through Lp
+            for(auto i : lp)
+                for(auto e : elementsOf[i])
+                {
+                    if(isAbsorbed[e])
+                        continue;
+
+                    if(outside[e] < 0)
+                    {
+                        auto &le = elements[e];
+                        le.erase(std::remove_if(le.begin(), le.end(), [&](size_t j){ return isEliminated[j] != 0; }), le.end());
+
+                        outside[e] = le.size();
+                        touched.push_back(e);
+                    }
+
+                    outside[e]--;
+                }
+
+            for(auto i : lp)
+            {
+                auto &ei = elementsOf[i];
+                ei.erase(std::remove_if(ei.begin(), ei.end(), [&](size_t e){ return isAbsorbed[e] != 0; }), ei.end());
+
+                // variables of Lp are reached through p now
+                auto &ai = adjacent[i];
+                ai.erase(std::remove_if(ai.begin(), ai.end(), [&](size_t j){ return isEliminated[j] || mark[j] == k; }), ai.end());
+
+                size_t d = ai.size() + lp.size() - 1;
+                for(auto e : ei)
+                    d += outside[e];
+
+                ei.push_back(p);
+
+                queue.erase({degree[i], i});
+                degree[i] = std::min(d, n - order.size() - 1);
+                queue.insert({degree[i], i});
+            }
+
+            for(auto e : touched)
+                outside[e] = -1;
+
+            touched.clear();
+        }
+
+        return order;
+    }
+
+    // Left-looking Gilbert-Peierls LU with partial pivoting over columns in minimum degree order.
+    // Column k of L is found by a sparse triangular solve with already computed columns, visiting
+    // only the rows reachable from the nonzeros of A(:, k), so work is proportional to the flops.
+    // U is not kept, det = sign(rows) * sign(columns) * product of pivots.
+    double calculateDeterminantLU() const
+    {
+        if(!isSquare())
+            throw std::runtime_error("Matrix should be square");
+
+        const auto n = _rows;
+        const auto order = minimumDegreeOrdering();
+
+        constexpr auto none = static_cast<size_t>(-1);
+        std::vector<size_t> pivotOf(n, none);
+
+        // L by columns, row indexes are original rows, the pivot row goes first with 1
+        std::vector<size_t> lPointers(1, 0);
+        std::vector<size_t> lRows;
+        std::vector<double> lValues;
+        lRows.reserve(nonZeros() + n);
+        lValues.reserve(nonZeros() + n);
+
+        std::vector<double> x(n, 0.);
+        std::vector<size_t> reach(n);
+        std::vector<size_t> stack(n);
+        std::vector<size_t> stackPosition(n);
+        std::vector<size_t> visited(n, 0);
+
+        double mantissa = 1.;
+        int exponent = 0;
+
+        for(auto k = 0u; k < n; k++)
+        {
+            const auto col = order[k];
+
+            // rows reachable from the column pattern through the graph of L, in topological order
+            auto top = n;
+            for(auto p = _colPointers[col]; p < _colPointers[col + 1]; p++)
+            {
+                const auto start = _rowIndexes[p];
+                if(visited[start] == k + 1)
+                    continue;
+
+                size_t depth = 0;
+                stack[0] = start;
+                visited[start] = k + 1;
+                stackPosition[0] = pivotOf[start] == none ? 0 : lPointers[pivotOf[start]];
+
+                while(depth != none)
+                {
+                    const auto j = stack[depth];
+                    const auto column = pivotOf[j];
+                    const auto last = column == none ? 0 : lPointers[column + 1];
+
+                    bool isDone = true;
+                    for(auto &q = stackPosition[depth]; q < last; q++)
+                    {
+                        const auto i = lRows[q];
+                        if(visited[i] == k + 1)
+                            continue;
+
+                        visited[i] = k + 1;
+                        q++;
+
+                        depth++;
+                        stack[depth] = i;
+                        stackPosition[depth] = pivotOf[i] == none ? 0 : lPointers[pivotOf[i]];
+                        isDone = false;
+                        break;
+                    }
+
+                    if(isDone)
+                    {
+                        reach[--top] = j;
+                        depth--;
+                    }
+                }
+            }
+
+            for(auto p = _colPointers[col]; p < _colPointers[col + 1]; p++)
+                x[_rowIndexes[p]] = _values[p];
+
+            // x = L^-1 A(:, col) over the reach, rows without a pivot yet stay as candidates
+            auto pivot = none;
+            double pivotMagnitude = 0.;
+
+            for(auto t = top; t < n; t++)
+            {
+                const auto j = reach[t];
+                const auto column = pivotOf[j];
+
+                if(column == none)
+                {
+                    if(std::fabs(x[j]) > pivotMagnitude)
+                    {
+                        pivotMagnitude = std::fabs(x[j]);
+                        pivot = j;
+                    }
+
+                    continue;
+                }
+
+                const auto xj = x[j];
+                for(auto q = lPointers[column] + 1; q < lPointers[column + 1]; q++)
+                    x[lRows[q]] -= lValues[q] * xj;
+            }
+
+            if(pivot == none)
+                return 0.;
+
+            const auto u = x[pivot];
+            pivotOf[pivot] = k;
+            MATH_PROFILE_COUNT(pivots, 1);
+
+            int e = 0;
+            mantissa = std::frexp(mantissa * u, &e);
+            exponent += e;
+
+            lRows.push_back(pivot);
+            lValues.push_back(1.);
+
+            for(auto t = top; t < n; t++)
+            {
+                const auto i = reach[t];
+                if(pivotOf[i] == none && x[i] != 0.)
+                {
+                    lRows.push_back(i);
+                    lValues.push_back(x[i] / u);
+                }
+
+                x[i] = 0.;
+            }
+
+            lPointers.push_back(lRows.size());
+        }
+
+        const auto sign = permutationSign(pivotOf) * permutationSign(order);
+        return sign * std::ldexp(mantissa, exponent);
+    }
+
+    std::vector<size_t> _colPointers;
+    std::vector<size_t> _rowIndexes;
+    std::vector<double> _values;
+    size_t _rows = 0;
+    size_t _cols = 0;
+
+private:
+    // parity of the cycles
+    static int permutationSign(const std::vector<size_t> &permutation)
+    {
+        std::vector<char> seen(permutation.size(), 0);
+        int sign = 1;
+
+        for(auto i = 0u; i < permutation.size(); i++)
+        {
+            if(seen[i])
+                continue;
+
+            size_t length = 0;
+            for(auto j = i; !seen[j]; j = permutation[j])
+            {
+                seen[j] = 1;
+                length++;
+            }
+
+            if(length % 2 == 0)
+                sign = -sign;
+        }
+
+        return sign;
+    }
+};
+
+}
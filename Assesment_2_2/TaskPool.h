@@ -0,0 +1,202 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace math {
+
+// tasks spawned together, wait() returns when all of them are done
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+private:
+    friend class TaskPool;
+
+    std::atomic<size_t> _pending{0};
+    std::mutex _mutex;
+    std::exception_ptr _error;
+};
+
+// Work-stealing pool for recursive tasks. Every worker owns a deque: it pushes and pops
+// its own tasks at the back (depth first, cache friendly) while idle workers steal from
+// the front, which holds the oldest and so the biggest tasks. Threads waiting for a group
+// run tasks meanwhile, so nested spawn and wait don't block workers.
+// The thread that creates the pool owns deque 0 and takes part as worker 0.
+class TaskPool {
+public:
+    explicit TaskPool(size_t threads = std::thread::hardware_concurrency())
+    {
+        threads = std::max<size_t>(threads, 1);
+
+        for(auto i = 0u; i < threads; i++)
+            _queues.push_back(std::make_unique<Queue>());
+
+        for(auto i = 1u; i < threads; i++)
+            _workers.emplace_back([this, i](){ work(i); });
+    }
+
+    ~TaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+
+        _wake.notify_all();
+
+        for(auto &worker : _workers)
+            worker.join();
+    }
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    size_t size() const { return _queues.size(); }
+
+    void spawn(TaskGroup &group, std::function<void()> body)
+    {
+        group._pending++;
+
+        // counted before it is visible, so a thief never takes the count below zero
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queued++;
+        }
+
+        auto &queue = *_queues[currentIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue._mutex);
+            queue._tasks.push_back({std::move(body), &group});
+        }
+
+        _wake.notify_one();
+    }
+
+    void wait(TaskGroup &group)
+    {
+        const auto index = currentIndex();
+
+        while(group._pending.load())
+            if(!runOne(index))
+                std::this_thread::yield();
+
+        std::lock_guard<std::mutex> lock(group._mutex);
+        if(group._error)
+        {
+            auto error = group._error;
+            group._error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct Task {
+        std::function<void()> _body;
+        TaskGroup *_group = nullptr;
+    };
+
+    struct Queue {
+        std::mutex _mutex;
+        std::deque<Task> _tasks;
+    };
+
+    size_t currentIndex() const
+    {
+        return t_pool == this ? t_index : 0;
+    }
+
+    bool pop(size_t index, Task &task)
+    {
+        auto &queue = *_queues[index];
+        std::lock_guard<std::mutex> lock(queue._mutex);
+        if(queue._tasks.empty())
+            return false;
+
+        task = std::move(queue._tasks.back());
+        queue._tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t index, Task &task)
+    {
+        for(auto k = 1u; k < _queues.size(); k++)
+        {
+            auto &queue = *_queues[(index + k) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue._mutex);
+            if(queue._tasks.empty())
+                continue;
+
+            task = std::move(queue._tasks.front());
+            queue._tasks.pop_front();
+            return true;
+        }
+
+        return false;
+    }
+
+    bool runOne(size_t index)
+    {
+        Task task;
+        if(!pop(index, task) && !steal(index, task))
+            return false;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queued--;
+        }
+
+        try {
+            task._body();
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(task._group->_mutex);
+            if(!task._group->_error)
+                task._group->_error = std::current_exception();
+        }
+
+        task._group->_pending--;
+        return true;
+    }
+
+    void work(size_t index)
+    {
+        t_pool = this;
+        t_index = index;
+
+        for(;;)
+        {
+            if(runOne(index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this](){ return _stop || _queued; });
+
+            if(_stop)
+                return;
+        }
+    }
+
+    static inline thread_local const TaskPool *t_pool = nullptr;
+    static inline thread_local size_t t_index = 0;
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    size_t _queued = 0;
+    bool _stop = false;
+};
+
+}
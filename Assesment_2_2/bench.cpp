@@ -0,0 +1,344 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+
+#include "Matrix.h"
+
+// every allocation of the process goes through here and is counted
+static std::atomic<size_t> g_Allocations{0};
+static std::atomic<size_t> g_AllocatedBytes{0};
+
+void *operator new(size_t size)
+{
+    g_Allocations++;
+    g_AllocatedBytes += size;
+
+    if(auto p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+struct BenchOptions {
+    std::vector<size_t> _sizes = {4, 8, 10, 16, 64, 256};
+    std::vector<std::string> _kinds = {"dense", "sparse", "integer", "banded", "near-singular"};
+    unsigned _seed = 42;
+    size_t _repeat = 3;
+    size_t _threads = 0;
+};
+
+template<class T>
+std::vector<T> splitList(const std::string &text, T (*convert)(const std::string &))
+{
+    std::vector<T> res;
+    std::istringstream stream(text);
+    std::string item;
+
+    while(std::getline(stream, item, ','))
+        if(!item.empty())
+            res.push_back(convert(item));
+
+    return res;
+}
+
+BenchOptions parseBenchOptions(int argc, char* argv[])
+{
+    BenchOptions res;
+
+    for(auto i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const auto value = arg.substr(arg.find('=') + 1);
+
+        if(arg.rfind("--sizes=", 0) == 0)
+            res._sizes = splitList<size_t>(value, [](const std::string &s){ return static_cast<size_t>(std::stoul(s)); });
+        else if(arg.rfind("--kinds=", 0) == 0)
+            res._kinds = splitList<std::string>(value, [](const std::string &s){ return s; });
+        else if(arg.rfind("--seed=", 0) == 0)
+            res._seed = std::stoul(value);
+        else if(arg.rfind("--repeat=", 0) == 0)
+            res._repeat = std::max<size_t>(1, std::stoul(value));
+        else if(arg.rfind("--threads=", 0) == 0)
+            res._threads = std::stoul(value);
+        else
+            throw std::runtime_error("Unknown option: " + arg);
+    }
+
+    return res;
+}
+
+math::Matrix generateMatrix(const std::string &kind, size_t n, std::mt19937 &generator)
+{
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+    math::Matrix mtx(n, n);
+
+    if(kind == "dense")
+    {
+        for(auto i = 0u; i < n; i++)
+            for(auto j = 0u; j < n; j++)
+                mtx(i, j) = distribution(generator);
+    }
+    else if(kind == "sparse")
+    {
+        // about 4 nonzeros per row around a nonzero diagonal
+        std::bernoulli_distribution isNonZero(std::min(1., 3. / n));
+        for(auto i = 0u; i < n; i++)
+        {
+            mtx(i, i) = 2. + distribution(generator);
+            for(auto j = 0u; j < n; j++)
+                if(j != i && isNonZero(generator))
+                    mtx(i, j) = distribution(generator);
+        }
+    }
+    else if(kind == "integer")
+    {
+        std::uniform_int_distribution<int> integers(-99, 99);
+        for(auto i = 0u; i < n; i++)
+            for(auto j = 0u; j < n; j++)
+                mtx(i, j) = integers(generator);
+    }
+    else if(kind == "banded")
+    {
+        for(size_t i = 0; i < n; i++)
+            for(size_t j = i > 3 ? i - 3 : 0; j < std::min(n, i + 4); j++)
+                mtx(i, j) = distribution(generator);
+    }
+    else if(kind == "near-singular")
+    {
+        // the last row is the first one plus a 1e-10 perturbation
+        for(auto i = 0u; i < n; i++)
+            for(auto j = 0u; j < n; j++)
+                mtx(i, j) = distribution(generator);
+
+        if(n > 1)
+            for(auto j = 0u; j < n; j++)
+                mtx(n - 1, j) = mtx(0, j) + 1e-10 * distribution(generator);
+    }
+    else
+        throw std::runtime_error("Unknown matrix kind: " + kind);
+
+    return mtx;
+}
+
+// double-double number, the unevaluated sum of two doubles with about 32 significant digits
+struct DoubleDouble {
+    double _hi = 0.;
+    double _lo = 0.;
+
+    DoubleDouble() = default;
+    DoubleDouble(double hi, double lo = 0.) : _hi(hi), _lo(lo) {}
+
+    // exact sum of two doubles, a rounded one and its error
+    static DoubleDouble twoSum(double a, double b)
+    {
+        const auto s = a + b;
+        const auto bb = s - a;
+        return {s, (a - (s - bb)) + (b - bb)};
+    }
+
+    // the same for |a| >= |b|
+    static DoubleDouble quickTwoSum(double a, double b)
+    {
+        const auto s = a + b;
+        return {s, b - (s - a)};
+    }
+
+    // exact product of two doubles, the error comes from the fused multiply-add
+    static DoubleDouble twoProd(double a, double b)
+    {
+        const auto p = a * b;
+        return {p, std::fma(a, b, -p)};
+    }
+
+    DoubleDouble operator-() const { return {-_hi, -_lo}; }
+
+    DoubleDouble operator+(const DoubleDouble &other) const
+    {
+        auto s = twoSum(_hi, other._hi);
+        const auto t = twoSum(_lo, other._lo);
+        s = quickTwoSum(s._hi, s._lo + t._hi);
+        return quickTwoSum(s._hi, s._lo + t._lo);
+    }
+
+    DoubleDouble operator-(const DoubleDouble &other) const { return *this + -other; }
+
+    DoubleDouble operator*(const DoubleDouble &other) const
+    {
+        const auto p = twoProd(_hi, other._hi);
+        return quickTwoSum(p._hi, p._lo + (_hi * other._lo + _lo * other._hi));
+    }
+
+    // long division, each quotient digit takes the remainder down by 53 bits
+    DoubleDouble operator/(const DoubleDouble &other) const
+    {
+        const auto q1 = _hi / other._hi;
+        const auto r = *this - other * q1;
+        const auto q2 = r._hi / other._hi;
+        const auto q3 = (r - other * q2)._hi / other._hi;
+        return quickTwoSum(q1, q2) + q3;
+    }
+
+    long double value() const { return static_cast<long double>(_hi) + _lo; }
+};
+
+// partial pivoting LU in double-double, or the exact value for integer matrices.
+// Its relative error is about the condition number times 1e-32, so it stays far below
+// the double errors even for the 1e-10 near-singular matrices
+long double referenceDeterminant(const math::Matrix &mtx)
+{
+    math::IntegerMatrix integers;
+    if(mtx.toIntegers(integers))
+        return std::stold(integers.calculateDeterminantModular().toString());
+
+    const auto n = mtx.rows();
+    std::vector<DoubleDouble> a(mtx.data(), mtx.data() + n * n);
+    DoubleDouble det = 1.;
+
+    for(auto k = 0u; k < n; k++)
+    {
+        auto pivot = k;
+        for(auto i = k + 1; i < n; i++)
+            if(std::fabs(a[i * n + k]._hi) > std::fabs(a[pivot * n + k]._hi))
+                pivot = i;
+
+        if(a[pivot * n + k]._hi == 0.)
+            return 0.;
+
+        if(pivot != k)
+        {
+            std::swap_ranges(a.begin() + pivot * n, a.begin() + (pivot + 1) * n, a.begin() + k * n);
+            det = -det;
+        }
+
+        det = det * a[k * n + k];
+
+        for(auto i = k + 1; i < n; i++)
+        {
+            const auto factor = a[i * n + k] / a[k * n + k];
+            for(auto j = k + 1; j < n; j++)
+                a[i * n + j] = a[i * n + j] - factor * a[k * n + j];
+        }
+    }
+
+    return det.value();
+}
+
+// exponential and exact algorithms only run where they finish in reasonable time
+bool isApplicable(math::DeterminantAlgorithm algorithm, const math::Matrix &mtx, bool isInteger)
+{
+    const auto n = mtx.rows();
+
+    switch (algorithm) {
+    case math::DeterminantAlgorithm::laplace:
+    case math::DeterminantAlgorithm::laplace_parallel:
+    case math::DeterminantAlgorithm::laplace_fixed:
+        return n <= 10 || mtx.density() <= 3. / n;
+    case math::DeterminantAlgorithm::laplace_dp:
+        return n <= 20;
+    case math::DeterminantAlgorithm::bareiss:
+        return isInteger && n <= 64;
+    case math::DeterminantAlgorithm::modular:
+        return isInteger;
+    default:
+        return true;
+    }
+}
+
+// CSV with one line per matrix and algorithm, time is the best of the repeats
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    try {
+        options = parseBenchOptions(argc, argv);
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    const std::map<std::string, math::DeterminantAlgorithm> algorithms(math::g_DeterminantAlgorithms.begin(),
+                                                                      math::g_DeterminantAlgorithms.end());
+
+    std::cout << "kind,n,seed,algorithm,seconds,allocations,allocated_bytes,determinant,reference,relative_error" << std::endl;
+    std::cout.precision(10);
+
+    for(const auto &kind : options._kinds)
+        for(auto n : options._sizes)
+        {
+            std::mt19937 generator(options._seed + n);
+            math::Matrix mtx;
+
+            try {
+                mtx = generateMatrix(kind, n, generator);
+            }
+            catch(std::exception &ex)
+            {
+                std::cerr << ex.what() << std::endl;
+                return 1;
+            }
+
+            const auto reference = referenceDeterminant(mtx);
+            math::IntegerMatrix integers;
+            const auto isInteger = mtx.toIntegers(integers);
+
+            for(const auto &[name, algorithm] : algorithms)
+            {
+                if(!isApplicable(algorithm, mtx, isInteger))
+                    continue;
+
+                double best = 0.;
+                double det = 0.;
+                size_t allocations = 0;
+                size_t bytes = 0;
+
+                try {
+                    for(auto r = 0u; r < options._repeat; r++)
+                    {
+                        const auto allocationsBefore = g_Allocations.load();
+                        const auto bytesBefore = g_AllocatedBytes.load();
+                        const auto start = std::chrono::steady_clock::now();
+
+                        det = mtx.calculateDeterminant(algorithm, options._threads);
+
+                        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+                        if(!r || seconds.count() < best)
+                            best = seconds.count();
+
+                        allocations = g_Allocations.load() - allocationsBefore;
+                        bytes = g_AllocatedBytes.load() - bytesBefore;
+                    }
+                }
+                catch(std::exception &ex)
+                {
+                    std::cerr << kind << " " << n << " " << name << ": " << ex.what() << std::endl;
+                    continue;
+                }
+
+                const auto error = reference == 0.
+                    ? std::fabs(static_cast<long double>(det))
+                    : std::fabs((static_cast<long double>(det) - reference) / reference);
+
+                std::cout << kind << "," << n << "," << options._seed << "," << name << "," << best << ","
+                          << allocations << "," << bytes << "," << det << "," << reference << "," << static_cast<double>(error) << std::endl;
+            }
+        }
+
+    return 0;
+}
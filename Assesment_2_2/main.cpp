@@ -1,32 +1,1259 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <random>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <memory>
 
+#include <unistd.h>
+
+#include "Batch.h"
+#include "DeterminantCache.h"
+#include "IncrementalDeterminant.h"
 #include "Matrix.h"
+#include "MatrixFile.h"
+#include "OutOfCoreLU.h"
 
 using namespace std;
 
-math::Matrix readMatrix(std::ifstream &inputFile)
+struct Options {
+    math::DeterminantAlgorithm _algorithm = math::DeterminantAlgorithm::automatic;
+    size_t _threads = 0;
+    size_t _laplaceCutoff = math::Matrix::s_LaplaceCutoff;
+    std::string _writeBinary;
+    bool _readStats = false;
+    bool _profile = false;
+    size_t _memoryBudget = 0;
+    std::string _cache;
+    size_t _cacheSize = math::DeterminantCache::s_DefaultCapacity;
+};
+
+Options parseOptions(int argc, char* argv[], int first)
 {
-    math::Matrix mtx;
+    Options res;
 
-    std::string line;
-    while (std::getline(inputFile, line)) {
-        std::istringstream lineStream(line);
+    for(auto i = first; i < argc; i++)
+    {
+        const std::string arg = argv[i];
 
-        std::vector<double> values;
-        double value;
+        if(arg.rfind("--algorithm=", 0) == 0)
+        {
+            auto it = math::g_DeterminantAlgorithms.find(arg.substr(arg.find('=') + 1));
+            if(it == math::g_DeterminantAlgorithms.end())
+                throw std::runtime_error("Unknown determinant algorithm: " + arg);
+
+            res._algorithm = it->second;
+        }
+        else if(arg.rfind("--threads=", 0) == 0)
+            res._threads = std::stoul(arg.substr(arg.find('=') + 1));
+        else if(arg.rfind("--laplace-cutoff=", 0) == 0)
+            res._laplaceCutoff = std::stoul(arg.substr(arg.find('=') + 1));
+        else if(arg.rfind("--write-binary=", 0) == 0)
+            res._writeBinary = arg.substr(arg.find('=') + 1);
+        else if(arg == "--read-stats")
+            res._readStats = true;
+        else if(arg.rfind("--memory-budget=", 0) == 0)
+            res._memoryBudget = std::stoul(arg.substr(arg.find('=') + 1)) << 20;
+        else if(arg.rfind("--cache=", 0) == 0)
+            res._cache = arg.substr(arg.find('=') + 1);
+        else if(arg.rfind("--cache-size=", 0) == 0)
+            res._cacheSize = std::stoul(arg.substr(arg.find('=') + 1)) << 20;
+        else if(arg == "--profile")
+        {
+#ifndef MATH_PROFILE
+            throw std::runtime_error("Profiling is compiled into Assesment_2_2_profile only");
+#endif
+            res._profile = true;
+        }
+        else
+            throw std::runtime_error("Unknown option: " + arg);
+    }
+
+    return res;
+}
+
+// the algorithm determinantText computes with, sparse input goes to sparse LU and the exact algorithms
+// only when they are asked, integer input within the exact limits goes to an exact one
+math::DeterminantAlgorithm determinantAlgorithm(const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                                                const math::SparseMatrix &sparse, const Options &options)
+{
+    if(options._algorithm != math::DeterminantAlgorithm::automatic)
+        return options._algorithm;
+
+    if(!sparse.isEmpty())
+        return math::DeterminantAlgorithm::lu_sparse;
+
+    return math::Matrix::automaticAlgorithm(matrix.rows(), !integers.isEmpty(), matrix.density(),
+                                            integers.isEmpty() ? 0 : integers.hadamardBits());
+}
+
+// determinant as it is printed, integer input keeps every digit of the exact value.
+// A sparse matrix comes with an empty dense one and goes to sparse LU unless another algorithm is asked,
+// the dense copy is made for the other ones.
+std::string determinantText(const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                            const math::SparseMatrix &sparse, const Options &options)
+{
+    if(sparse.isEmpty() && matrix.isEmpty())
+        throw std::runtime_error("Matrix should not be empty");
+
+    if(sparse.isEmpty() ? !matrix.isSquare() : !sparse.isSquare())
+        throw std::runtime_error("Matrix should be square");
+
+    const auto algorithm = determinantAlgorithm(matrix, integers, sparse, options);
+
+    if(algorithm == math::DeterminantAlgorithm::bareiss && !integers.isEmpty())
+        return integers.calculateDeterminantBareiss().toString();
+
+    if(algorithm == math::DeterminantAlgorithm::modular && !integers.isEmpty())
+        return integers.calculateDeterminantModular(options._threads).toString();
+
+    if(!sparse.isEmpty())
+    {
+        if(algorithm == math::DeterminantAlgorithm::lu_sparse)
+            return std::to_string(sparse.calculateDeterminantLU());
+
+        // the exact copy of a big file is not kept, the dense one gives it back
+        auto dense = options;
+        dense._algorithm = algorithm;
+
+        const auto denseMatrix = math::Matrix::fromSparse(sparse);
+        math::IntegerMatrix denseIntegers;
+        if(integers.isEmpty())
+            denseMatrix.toIntegers(denseIntegers);
+
+        return determinantText(denseMatrix, integers.isEmpty() ? denseIntegers : integers, math::SparseMatrix(), dense);
+    }
+
+    if(algorithm == math::DeterminantAlgorithm::laplace_parallel)
+        return std::to_string(matrix.calculateDeterminantLaplaceParallel(options._threads, options._laplaceCutoff));
+
+    const auto det = matrix.calculateDeterminant(algorithm, options._threads);
+    if(!std::isinf(det))
+        return std::to_string(det);
+
+    // integer matrices above the exact limits overflow the double range, write them from log |det|
+    const auto [sign, logAbs] = matrix.factorize().slogdet();
+    const auto log10Abs = logAbs / std::log(10.);
+    const auto exponent = std::floor(log10Abs);
+
+    std::ostringstream res;
+    res.precision(12);
+    res << sign * std::pow(10., log10Abs - exponent) << "e+" << static_cast<long long>(exponent);
+    return res.str();
+}
+
+std::string algorithmName(math::DeterminantAlgorithm algorithm)
+{
+    for(const auto &[name, value] : math::g_DeterminantAlgorithms)
+        if(value == algorithm)
+            return name;
+
+    return "unknown";
+}
+
+// algorithm and precision the determinant is computed with as determinantText chooses them,
+// results of the same matrix computed another way are cached apart
+std::string determinantMode(const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                            const math::SparseMatrix &sparse, const Options &options)
+{
+    const auto algorithm = determinantAlgorithm(matrix, integers, sparse, options);
+    const auto isExact = (!integers.isEmpty() || !sparse.isEmpty()) &&
+                         (algorithm == math::DeterminantAlgorithm::bareiss || algorithm == math::DeterminantAlgorithm::modular);
+
+    return algorithmName(algorithm) + (isExact ? "-exact" : "-double");
+}
+
+// determinantText through the cache when there is one
+std::string cachedDeterminantText(math::DeterminantCache *cache, const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                                  const math::SparseMatrix &sparse, const Options &options)
+{
+    if(!cache)
+        return determinantText(matrix, integers, sparse, options);
+
+    return cache->get(math::DeterminantCache::key(matrix, integers, sparse, determinantMode(matrix, integers, sparse, options)),
+                      [&](){ return determinantText(matrix, integers, sparse, options); });
+}
+
+void writeCacheStatistics(const math::DeterminantCache *cache)
+{
+    if(!cache)
+        return;
+
+    const auto statistics = cache->statistics();
+    std::cout << "Cache: " << statistics._hits << " hits (" << statistics._memoryHits << " in memory), "
+              << statistics._misses << " misses, " << statistics._evictions << " evicted, "
+              << cache->diskSize() << " bytes on disk" << std::endl;
+}
+
+// counters and phase times as JSON on stderr, so the results on stdout stay as they are
+void writeProfile(const Options &options)
+{
+#ifdef MATH_PROFILE
+    if(options._profile)
+        math::Profile::instance().writeJson(std::cerr);
+#else
+    (void)options;
+#endif
+}
+
+// binary matrix file factorized in a tile file next to it within the memory budget.
+// The file is checked as the in-core paths check the matrix and the result goes through the cache,
+// the elements are hashed a block at a time so they never stay in memory together.
+int determinant_out_of_core(const std::string &path, const Options &options)
+{
+    try {
+        if(options._algorithm != math::DeterminantAlgorithm::automatic)
+            throw std::runtime_error("Out-of-core determinant is LU, --algorithm doesn't apply to it");
+
+        std::unique_ptr<math::DeterminantCache> cache;
+        std::string key;
+        {
+            MATH_PROFILE_PHASE("validate");
 
-        while (lineStream >> value) {
-            values.push_back(value);
+            math::MappedFile file(path);
+
+            math::BinaryMatrixHeader header;
+            if(file.size() < sizeof(header) || !math::isBinaryMatrix(file.data(), file.size()))
+                throw std::runtime_error("Out-of-core determinant needs a binary matrix file, convert it with --write-binary");
+
+            std::memcpy(&header, file.data(), sizeof(header));
+            if(!header._rows || !header._cols)
+                throw std::runtime_error("Matrix should not be empty");
+
+            if(header._rows != header._cols)
+                throw std::runtime_error("Matrix should be square");
+
+            if(!options._cache.empty())
+            {
+                cache = std::make_unique<math::DeterminantCache>(options._cache, options._cacheSize);
+
+                const size_t block = size_t(1) << 20;
+
+                math::DeterminantCache::Digest digest;
+                for(auto offset = sizeof(header); offset < file.size(); offset += block)
+                {
+                    const auto bytes = std::min(block, file.size() - offset);
+                    digest.add(file.data() + offset, bytes);
+                    file.doneWith(offset, bytes);
+                }
+
+                key = math::DeterminantCache::key(digest, header._rows, header._cols, false, "lu-out-of-core-double");
+            }
         }
 
+        auto compute = [&](){
+            MATH_PROFILE_PHASE("compute");
+            return math::OutOfCoreLU::slogdet(path, path + ".tiles", options._memoryBudget);
+        };
+
+        // sign and log |det| in one line of the cache, log |det| of a singular matrix is -inf
+        // which strtod reads back and streams don't
+        auto [sign, logAbs] = cache ? std::pair<double, double>() : compute();
+        if(cache)
+        {
+            std::istringstream result(cache->get(key, [&](){
+                const auto computed = compute();
+
+                std::ostringstream res;
+                res.precision(17);
+                res << computed.first << " " << computed.second;
+                return res.str();
+            }));
+
+            std::string signText, logAbsText;
+            if(!(result >> signText >> logAbsText))
+                throw std::runtime_error("Wrong cached out-of-core determinant: " + result.str());
+
+            sign = std::stod(signText);
+            logAbs = std::stod(logAbsText);
+        }
+
+        std::cout << "Determinant for matrix: " << path << std::endl;
+        std::cout << "Is: " << sign * std::exp(logAbs) << std::endl;
+        std::cout << "Sign: " << sign << ", log |det|: " << logAbs << std::endl;
+        writeCacheStatistics(cache.get());
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// every matrix of a directory, wildcard pattern or multi-matrix file, one thread per matrix
+int determinants_batch(const std::string &input, Options options)
+{
+    try {
+        math::Batch batch(input);
+        std::unique_ptr<math::DeterminantCache> cache;
+        if(!options._cache.empty())
+            cache = std::make_unique<math::DeterminantCache>(options._cache, options._cacheSize);
+
+        math::TaskPool pool(options._threads ? options._threads : std::thread::hardware_concurrency());
+
+        // parallel over matrices, so each of them is computed on one thread
+        options._threads = 1;
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto count = batch.run(pool, [&options, &cache](const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                                                              const math::SparseMatrix &sparse){
+            return cachedDeterminantText(cache.get(), matrix, integers, sparse, options);
+        }, std::cout);
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Batch: " << count << " matrices in " << seconds.count() << " s: "
+                  << count / seconds.count() << " matrices/s" << std::endl;
+        writeCacheStatistics(cache.get());
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+math::Matrix randomMatrix(size_t n, std::mt19937 &generator)
+{
+    std::uniform_int_distribution<int> distribution(-9, 9);
+    std::bernoulli_distribution isZero(0.2);
+
+    math::Matrix mtx;
+    for(auto i = 0u; i < n; i++)
+    {
+        std::vector<double> values;
+        for(auto j = 0u; j < n; j++)
+            values.push_back(isZero(generator) ? 0. : distribution(generator));
+
         mtx.addRow(math::Vector(std::move(values)));
     }
 
     return mtx;
 }
 
+bool isSameDeterminant(double expected, double actual)
+{
+    return std::fabs(expected - actual) <= 1e-9 * std::max(1., std::fabs(expected));
+}
+
+// file of the tests in the temporary directory, named apart for every process
+// as both test programs run the tests at once under ctest -j
+std::string testPath(const std::string &name)
+{
+    return (std::filesystem::temp_directory_path() / ("Assesment_2_2_" + std::to_string(getpid()) + "_" + name)).string();
+}
+
+// every algorithm against Laplace expansion on the sample files and on random matrices
+int algorithms_test(const std::string &directory, math::TaskPool &pool)
+{
+    auto failures = 0;
+
+    auto check = [&failures](const std::string &name, const math::Matrix &mtx){
+        const auto laplace = mtx.calculateDeterminant(math::DeterminantAlgorithm::laplace);
+
+        for(const auto &[algorithmName, algorithm] : math::g_DeterminantAlgorithms)
+        {
+            const auto det = mtx.calculateDeterminant(algorithm);
+            if(isSameDeterminant(laplace, det))
+                continue;
+
+            failures++;
+            std::cerr << name << ": " << algorithmName << " gives " << std::to_string(det)
+                      << " instead of " << std::to_string(laplace) << std::endl;
+        }
+    };
+
+    for(auto i = 1; i <= 4; i++)
+    {
+        const auto name = directory + "/matrix_" + std::to_string(i) + ".txt";
+
+        try {
+            check(name, math::readMatrixFile(name, pool));
+        }
+        catch(std::exception &ex)
+        {
+            failures++;
+            std::cerr << name << ": " << ex.what() << std::endl;
+        }
+    }
+
+    std::mt19937 generator(501);
+    for(auto n = 1u; n <= 8; n++)
+        for(auto sample = 0; sample < 10; sample++)
+            check("random " + std::to_string(n) + "x" + std::to_string(n), randomMatrix(n, generator));
+
+    return failures;
+}
+
+// chunked text parsing, integer detection and the binary format give back the same matrix
+int matrix_file_test(math::TaskPool &pool)
+{
+    auto failures = 0;
+
+    std::mt19937 generator(39);
+    std::uniform_real_distribution<double> distribution(-1e3, 1e3);
+
+    const size_t n = 37;
+    std::ostringstream integerText, realText;
+    realText.precision(17);
+
+    math::Matrix expected(n, n);
+    for(auto i = 0u; i < n; i++)
+    {
+        for(auto j = 0u; j < n; j++)
+        {
+            expected(i, j) = distribution(generator);
+            realText << (j % 3 ? "\t" : "  ") << expected(i, j);
+            integerText << " " << (j % 2 ? "+" : "") << static_cast<int64_t>(i * n + j) - 700;
+        }
+
+        realText << (i % 2 ? "\r\n" : "\n\n");
+        integerText << "\n";
+    }
+
+    const auto realString = realText.str();
+    const auto integerString = integerText.str();
+
+    for(auto chunkBytes : {size_t(1), size_t(100), size_t(1) << 20})
+    {
+        math::IntegerMatrix integers;
+        const auto real = math::parseMatrixText(realString.data(), realString.data() + realString.size(), pool, &integers, nullptr, chunkBytes);
+        if(real._data != expected._data || !integers.isEmpty())
+        {
+            failures++;
+            std::cerr << "text matrix parsed in chunks of " << chunkBytes << " differs" << std::endl;
+        }
+
+        math::parseMatrixText(integerString.data(), integerString.data() + integerString.size(), pool, &integers, nullptr, chunkBytes);
+        if(integers.rows() != n || integers.cols() != n || integers(n - 1, n - 1) != static_cast<int64_t>(n * n - 1) - 700)
+        {
+            failures++;
+            std::cerr << "integer matrix parsed in chunks of " << chunkBytes << " differs" << std::endl;
+        }
+    }
+
+    const auto path = testPath("test.mtx");
+    math::writeMatrixBinary(expected, path);
+    const auto binary = math::readMatrixFile(path, pool);
+    std::filesystem::remove(path);
+
+    if(binary.rows() != n || binary._data != expected._data)
+    {
+        failures++;
+        std::cerr << "binary matrix differs" << std::endl;
+    }
+
+    // one text file of three matrices, the second is not square
+    std::ofstream(path) << "1 2\n3 4\n\n \n5 6\n" << integerString << "\n\n7\n";
+    {
+        std::ostringstream out;
+        math::Batch(path).run(pool, [](const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                                                      const math::SparseMatrix &sparse){
+            return determinantText(matrix, integers, sparse, Options());
+        }, out);
+
+        const auto expectedOut = path + "#1: -2\n" + path + "#2: error: Numbers of columns is defferent\n" + path + "#3: 7\n";
+        if(out.str() != expectedOut)
+        {
+            failures++;
+            std::cerr << "batch over a multi-matrix file gives\n" << out.str() << "instead of\n" << expectedOut;
+        }
+    }
+    std::filesystem::remove(path);
+
+    const std::string ragged = "1 2\n3\n";
+    try {
+        math::parseMatrixText(ragged.data(), ragged.data() + ragged.size(), pool);
+        failures++;
+        std::cerr << "ragged text matrix is accepted" << std::endl;
+    }
+    catch(std::runtime_error &) {}
+
+    return failures;
+}
+
+// A = L * U with unit lower triangular L, so det(A) is the product of the diagonal of U.
+// It is far beyond 64 bits and forces Bareiss elimination over to BigInteger.
+int bareiss_test()
+{
+    auto failures = 0;
+
+    const std::vector<int64_t> diagonal = {999999937, -999999929, 999999893, 999999883, -999999797, 999999761};
+    const auto n = diagonal.size();
+
+    std::mt19937 generator(35);
+    std::uniform_int_distribution<int64_t> distribution(-1000, 1000);
+
+    std::vector<int64_t> l(n * n, 0), u(n * n, 0);
+    for(auto i = 0u; i < n; i++)
+    {
+        l[i * n + i] = 1;
+        u[i * n + i] = diagonal[i];
+        for(auto j = 0u; j < i; j++)
+            l[i * n + j] = distribution(generator) % 10;
+        for(auto j = i + 1; j < n; j++)
+            u[i * n + j] = distribution(generator);
+    }
+
+    math::IntegerMatrix integers;
+    for(auto i = 0u; i < n; i++)
+    {
+        std::vector<int64_t> row(n, 0);
+        for(auto j = 0u; j < n; j++)
+            for(auto k = 0u; k < n; k++)
+                row[j] += l[i * n + k] * u[k * n + j];
+
+        integers.addRow(std::move(row));
+    }
+
+    math::BigInteger expected(1ll);
+    for(auto v : diagonal)
+        expected = expected * math::BigInteger(static_cast<long long>(v));
+
+    const auto det = integers.calculateDeterminantBareiss();
+    if(det != expected)
+    {
+        failures++;
+        std::cerr << "exact " << n << "x" << n << ": bareiss gives " << det.toString()
+                  << " instead of " << expected.toString() << std::endl;
+    }
+
+    for(auto threads : {1u, 3u})
+    {
+        const auto modular = integers.calculateDeterminantModular(threads);
+        if(modular == expected)
+            continue;
+
+        failures++;
+        std::cerr << "exact " << n << "x" << n << ": modular on " << threads << " threads gives "
+                  << modular.toString() << " instead of " << expected.toString() << std::endl;
+    }
+
+    return failures;
+}
+
+// multi-modular against Bareiss on integer matrices with growing entries, including singular ones
+int modular_test()
+{
+    auto failures = 0;
+
+    std::mt19937 generator(36);
+    for(auto n = 1u; n <= 24; n++)
+    {
+        std::uniform_int_distribution<int64_t> distribution(-(int64_t(1) << (n + 8)), int64_t(1) << (n + 8));
+
+        math::IntegerMatrix integers;
+        for(auto i = 0u; i < n; i++)
+        {
+            std::vector<int64_t> row(n);
+            for(auto &v : row)
+                v = distribution(generator);
+
+            // every fourth matrix repeats its first row
+            if(n % 4 == 0 && i == n - 1)
+                row = std::vector<int64_t>(integers._data.begin(), integers._data.begin() + n);
+
+            integers.addRow(std::move(row));
+        }
+
+        const auto bareiss = integers.calculateDeterminantBareiss();
+        const auto modular = integers.calculateDeterminantModular();
+        if(bareiss == modular)
+            continue;
+
+        failures++;
+        std::cerr << "random integer " << n << "x" << n << ": modular gives " << modular.toString()
+                  << " instead of " << bareiss.toString() << std::endl;
+    }
+
+    // above the exact limits integer input goes to LU, beyond the double range it is written from log |det|
+    std::uniform_int_distribution<int> small(-99, 99);
+    math::Matrix big(200, 200);
+    for(auto &v : big._data)
+        v = small(generator);
+
+    math::IntegerMatrix bigIntegers;
+    big.toIntegers(bigIntegers);
+
+    const math::SparseMatrix sparse;
+    const auto mode = determinantMode(big, bigIntegers, sparse, Options());
+    const auto text = determinantText(big, bigIntegers, sparse, Options());
+    const auto exact = bigIntegers.calculateDeterminantModular().toString();
+
+    const auto digits = exact.size() - (exact[0] == '-' ? 1 : 0);
+    const auto leading = std::stod(exact.substr(0, exact.size() - digits + 1) + "." + exact.substr(exact.size() - digits + 1, 12));
+    const auto exponent = text.find("e+");
+
+    if(mode != "lu-blocked-double" || exponent == std::string::npos || std::stoul(text.substr(exponent + 2)) != digits - 1 ||
+       std::fabs(std::stod(text.substr(0, exponent)) - leading) > 1e-9 * std::fabs(leading))
+    {
+        failures++;
+        std::cerr << "random integer 200x200 in " << mode << " gives " << text << " for " << leading << "e+" << digits - 1 << std::endl;
+    }
+
+    return failures;
+}
+
+// blocked LU against plain LU across block and tile edges
+int blocked_lu_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(38);
+
+    for(auto n : {1u, 2u, 5u, 16u, 17u, 63u, 64u, 65u, 150u, 300u})
+    {
+        std::uniform_real_distribution<double> distribution(-1., 1.);
+
+        math::Matrix mtx;
+        for(auto i = 0u; i < n; i++)
+        {
+            std::vector<double> values(n);
+            for(auto &v : values)
+                v = distribution(generator);
+
+            mtx.addRow(math::Vector(std::move(values)));
+        }
+
+        const auto lu = mtx.calculateDeterminantLU();
+        for(auto blockSize : {size_t(16), math::BlockedLU::s_BlockSize})
+        {
+            const auto det = mtx.calculateDeterminantBlockedLU(3, blockSize);
+            if(isSameDeterminant(lu, det))
+                continue;
+
+            failures++;
+            std::cerr << "random " << n << "x" << n << ": lu-blocked with block " << blockSize << " gives "
+                      << det << " instead of " << lu << std::endl;
+        }
+    }
+
+    return failures;
+}
+
+// sparse LU against dense LU, including a structurally singular matrix
+int sparse_test(math::TaskPool &pool)
+{
+    auto failures = 0;
+    std::mt19937 generator(41);
+
+    for(auto n : {1u, 3u, 64u, 100u, 250u})
+    {
+        std::uniform_real_distribution<double> distribution(-1., 1.);
+        std::bernoulli_distribution isNonZero(4. / n);
+
+        math::Matrix mtx(n, n);
+        for(auto i = 0u; i < n; i++)
+        {
+            mtx(i, (i * 7) % n) = distribution(generator);
+            for(auto j = 0u; j < n; j++)
+                if(isNonZero(generator))
+                    mtx(i, j) = distribution(generator);
+        }
+
+        const auto lu = mtx.calculateDeterminantLU();
+        const auto det = mtx.calculateDeterminant(math::DeterminantAlgorithm::lu_sparse);
+        if(!isSameDeterminant(lu, det))
+        {
+            failures++;
+            std::cerr << "random sparse " << n << "x" << n << ": lu-sparse gives " << det << " instead of " << lu << std::endl;
+        }
+
+        for(auto i = 0u; i < n; i++)
+            mtx(i, n / 2) = 0.;
+
+        if(mtx.toSparse().calculateDeterminantLU() != 0.)
+        {
+            failures++;
+            std::cerr << "random sparse " << n << "x" << n << " with zero column: lu-sparse is not zero" << std::endl;
+        }
+    }
+
+    // a big sparse text matrix is parsed straight into compressed columns
+    const size_t n = 80;
+    std::ostringstream text;
+    for(auto i = 0u; i < n; i++)
+    {
+        for(auto j = 0u; j < n; j++)
+            text << (j == i ? "2.5" : j == (i + 1) % n ? "-1" : (j % 2 ? "0" : "0.0")) << " ";
+
+        text << "\n";
+    }
+
+    const auto string = text.str();
+    math::SparseMatrix sparse;
+    const auto dense = math::parseMatrixText(string.data(), string.data() + string.size(), pool, nullptr, &sparse, 1000);
+
+    if(!dense.isEmpty() || sparse.nonZeros() != 2 * n || sparse(3, 4) != -1. || sparse(5, 5) != 2.5 || sparse(5, 7) != 0.)
+    {
+        failures++;
+        std::cerr << "sparse text matrix is not parsed as sparse" << std::endl;
+    }
+
+    // a small sparse all-integer matrix keeps its exact copy for the exact algorithms, 3^64 here,
+    // automatic mode still takes sparse LU
+    std::ostringstream diagonalText;
+    for(auto i = 0u; i < 64; i++)
+    {
+        for(auto j = 0u; j < 64; j++)
+            diagonalText << (i == j ? "3 " : "0 ");
+
+        diagonalText << "\n";
+    }
+
+    const auto diagonalString = diagonalText.str();
+    const std::string expected = "3433683820292512484657849089281";
+
+    math::IntegerMatrix integers;
+    const auto diagonal = math::parseMatrixText(diagonalString.data(), diagonalString.data() + diagonalString.size(),
+                                                pool, &integers, &sparse, 1000);
+
+    const auto binaryPath = testPath("sparse_integers_test.bin");
+    math::writeMatrixBinary(math::Matrix::fromSparse(sparse), binaryPath);
+
+    math::IntegerMatrix binaryIntegers;
+    math::SparseMatrix binarySparse;
+    const auto binary = math::readMatrixFile(binaryPath, pool, &binaryIntegers, &binarySparse);
+    std::filesystem::remove(binaryPath);
+
+    Options bareiss, modular;
+    bareiss._algorithm = math::DeterminantAlgorithm::bareiss;
+    modular._algorithm = math::DeterminantAlgorithm::modular;
+
+    for(const auto &[name, text] : {std::make_pair("bareiss", determinantText(diagonal, integers, sparse, bareiss)),
+                                    std::make_pair("binary", determinantText(binary, binaryIntegers, binarySparse, bareiss))})
+        if(text != expected)
+        {
+            failures++;
+            std::cerr << "sparse integer diagonal, " << name << ": " << text << " instead of " << expected << std::endl;
+        }
+
+    const auto automatic = determinantText(diagonal, integers, sparse, Options());
+    if(determinantMode(diagonal, integers, sparse, Options()) != "lu-sparse-double" ||
+       std::fabs(std::stod(automatic) - std::stod(expected)) > 1e-12 * std::stod(expected))
+    {
+        failures++;
+        std::cerr << "sparse integer diagonal, auto: " << automatic << " instead of sparse LU" << std::endl;
+    }
+
+    // a big one has no dense exact copy, the exact algorithms make it from the dense matrix when they are asked
+    const size_t bigSize = 2 * math::Matrix::s_ExactMaxSize;
+
+    std::ostringstream bigText;
+    for(auto i = 0u; i < bigSize; i++)
+    {
+        for(auto j = 0u; j < bigSize; j++)
+            bigText << (i == j ? "3 " : j == (i + 1) % bigSize ? "1 " : "0 ");
+
+        bigText << "\n";
+    }
+
+    // 3^128 - 1 with the cyclic shift
+    const std::string bigExpected = "11790184577738583171520872861412518665678211592275841109096960";
+
+    const auto bigString = bigText.str();
+    math::IntegerMatrix bigIntegers;
+    math::SparseMatrix bigSparse;
+    const auto bigDense = math::parseMatrixText(bigString.data(), bigString.data() + bigString.size(), pool, &bigIntegers, &bigSparse, 1000);
+
+    const auto bigModular = determinantText(bigDense, bigIntegers, bigSparse, modular);
+    if(!bigIntegers.isEmpty() || bigSparse.isEmpty() || determinantMode(bigDense, bigIntegers, bigSparse, Options()) != "lu-sparse-double" ||
+       bigModular != bigExpected)
+    {
+        failures++;
+        std::cerr << "sparse integer " << bigSize << "x" << bigSize << " keeps " << bigIntegers.rows() << " exact rows, modular gives "
+                  << bigModular << " instead of " << bigExpected << std::endl;
+    }
+
+    return failures;
+}
+
+// parallel expansion must reproduce the sequential one exactly, whatever the schedule
+int laplace_parallel_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(37);
+
+    for(auto n = 1u; n <= 9; n++)
+    {
+        std::uniform_real_distribution<double> distribution(-1., 1.);
+
+        std::vector<double> values(n * n);
+        for(auto &v : values)
+            v = distribution(generator);
+
+        math::Matrix mtx;
+        for(auto i = 0u; i < n; i++)
+            mtx.addRow(math::Vector(std::vector<double>(values.begin() + i * n, values.begin() + (i + 1) * n)));
+
+        const auto laplace = mtx.calculateDeterminantLaplaceExpansion();
+        for(auto cutoff : {1u, 3u, 7u})
+            for(auto threads : {1u, 2u, 5u})
+            {
+                const auto det = mtx.calculateDeterminantLaplaceParallel(threads, cutoff);
+                if(det == laplace)
+                    continue;
+
+                failures++;
+                std::cerr << "random " << n << "x" << n << ": laplace-parallel on " << threads << " threads with cutoff "
+                          << cutoff << " gives " << std::to_string(det) << " instead of " << std::to_string(laplace) << std::endl;
+            }
+    }
+
+    return failures;
+}
+
+// out-of-core LU in a tile file gives the in-core log-determinant for any tile size
+int out_of_core_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(47);
+
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+    const size_t n = 50;
+
+    math::Matrix mtx(n, n);
+    for(auto &v : mtx._data)
+        v = distribution(generator);
+
+    const auto [sign, logAbs] = mtx.factorize().slogdet();
+    const auto tilePath = testPath("test.tiles");
+    const auto binaryPath = testPath("test_ooc.mtx");
+
+    auto compare = [&](const std::string &name, std::pair<double, double> res){
+        if(res.first == sign && std::fabs(res.second - logAbs) <= 1e-9 * std::max(1., std::fabs(logAbs)))
+            return;
+
+        failures++;
+        std::cerr << "out-of-core " << name << " gives " << res.first << " " << res.second
+                  << " instead of " << sign << " " << logAbs << std::endl;
+    };
+
+    try {
+        for(auto tileSize : {1u, 7u, 16u, 50u})
+        {
+            math::OutOfCoreLU::writeTiles(mtx, tilePath, tileSize);
+            compare("with tiles of " + std::to_string(tileSize), math::OutOfCoreLU::slogdet(tilePath));
+        }
+
+        // 6 KB fit three columns of 2
+        math::writeMatrixBinary(mtx, binaryPath);
+        compare("within 6 KB", math::OutOfCoreLU::slogdet(binaryPath, tilePath, 6 << 10));
+
+        math::OutOfCoreLU::writeTiles(mtx, tilePath, 16);
+        math::OutOfCoreLU::slogdet(tilePath, 6 << 10);
+
+        failures++;
+        std::cerr << "out-of-core LU runs tiles of 16 within 6 KB" << std::endl;
+    }
+    catch(std::exception &ex)
+    {
+        if(std::string(ex.what()) != "Tiles of the file don't fit the memory budget")
+        {
+            failures++;
+            std::cerr << "out-of-core: " << ex.what() << std::endl;
+        }
+    }
+
+    // a singular matrix gives 0 with and without the cache, log |det| is -inf in the cached line
+    auto singular = mtx;
+    std::fill(singular._data.begin() + 7 * n, singular._data.begin() + 8 * n, 0.);
+    math::writeMatrixBinary(singular, binaryPath);
+
+    const auto cachePath = testPath("test_ooc_cache");
+    std::filesystem::remove_all(cachePath);
+
+    Options options;
+    options._memoryBudget = 1 << 20;
+
+    for(auto cache : {"", "cache", "cache"})
+    {
+        options._cache = *cache ? cachePath : "";
+
+        std::ostringstream output;
+        auto coutBuffer = std::cout.rdbuf(output.rdbuf());
+        const auto res = determinant_out_of_core(binaryPath, options);
+        std::cout.rdbuf(coutBuffer);
+
+        if(res || output.str().find("Is: 0\n") == std::string::npos)
+        {
+            failures++;
+            std::cerr << "out-of-core singular matrix" << (*cache ? " through the cache" : "") << " gives " << output.str() << std::endl;
+        }
+    }
+
+    std::filesystem::remove_all(cachePath);
+    std::filesystem::remove(tilePath);
+    std::filesystem::remove(binaryPath);
+    std::filesystem::remove(binaryPath + ".tiles");
+
+    return failures;
+}
+
+// cached results come back from memory and from disk, keys tell the shape and the mode apart
+int cache_test()
+{
+    auto failures = 0;
+
+    const auto cachePath = testPath("test_cache");
+    std::filesystem::remove_all(cachePath);
+
+    math::Matrix square(2, 2), row(1, 4);
+    square._data = row._data = {1., 2., 3., 4.};
+
+    const math::IntegerMatrix integers;
+    const math::SparseMatrix sparse;
+    const auto key = math::DeterminantCache::key(square, integers, sparse, "lu-double");
+
+    if(key == math::DeterminantCache::key(row, integers, sparse, "lu-double") ||
+       key == math::DeterminantCache::key(square, integers, sparse, "laplace-double"))
+    {
+        failures++;
+        std::cerr << "cache: the same key for another shape or mode" << std::endl;
+    }
+
+    size_t computed = 0;
+    auto compute = [&](){
+        computed++;
+        return std::to_string(square.calculateDeterminantLU());
+    };
+
+    try {
+        {
+            math::DeterminantCache cache(cachePath, math::DeterminantCache::s_DefaultCapacity, 2);
+            const auto first = cache.get(key, compute);
+            const auto second = cache.get(key, compute);
+            const auto statistics = cache.statistics();
+
+            if(first != "-2.000000" || second != first || computed != 1 ||
+               statistics._hits != 1 || statistics._memoryHits != 1 || statistics._misses != 1)
+            {
+                failures++;
+                std::cerr << "cache: " << first << " and " << second << " after " << computed << " computations, "
+                          << statistics._hits << " hits, " << statistics._misses << " misses" << std::endl;
+            }
+
+            // two entries in memory push the first one out to the disk only
+            cache.insert("a", "1");
+            cache.insert("b", "2");
+
+            std::string res;
+            if(!cache.find(key, res) || res != first || cache.statistics()._memoryHits != 1)
+            {
+                failures++;
+                std::cerr << "cache: the least recently used entry is not on disk only" << std::endl;
+            }
+        }
+
+        // another process finds the entries on disk
+        math::DeterminantCache cache(cachePath);
+        if(cache.get(key, compute) != "-2.000000" || computed != 1 || cache.statistics()._hits != 1)
+        {
+            failures++;
+            std::cerr << "cache: the entry doesn't persist" << std::endl;
+        }
+
+        // the newest entries stay within the size cap
+        math::DeterminantCache small(cachePath, 200);
+        for(auto i = 0; i < 20; i++)
+            small.insert(std::to_string(i) + "-1x1-lu-double", std::to_string(i));
+
+        std::string res;
+        if(small.diskSize() > 200 || !small.statistics()._evictions || !small.find("19-1x1-lu-double", res) || res != "19")
+        {
+            failures++;
+            std::cerr << "cache: " << small.diskSize() << " bytes on disk over the cap of 200" << std::endl;
+        }
+    }
+    catch(std::exception &ex)
+    {
+        failures++;
+        std::cerr << "cache: " << ex.what() << std::endl;
+    }
+
+    std::filesystem::remove_all(cachePath);
+
+    return failures;
+}
+
+// one factorization solves, inverts and gives the log-determinant past the double range
+int factorization_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(45);
+
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+    const size_t n = 40, k = 3;
+
+    math::Matrix mtx(n, n), b(n, k);
+    for(auto &v : mtx._data)
+        v = distribution(generator);
+
+    for(auto &v : b._data)
+        v = distribution(generator);
+
+    const auto factors = mtx.factorize();
+    const auto x = factors.solve(b);
+    const auto inverse = factors.inverse();
+
+    double residual = 0., inverseResidual = 0., columnDifference = 0.;
+    for(auto i = 0u; i < n; i++)
+    {
+        for(auto c = 0u; c < k; c++)
+        {
+            double ax = 0.;
+            for(auto j = 0u; j < n; j++)
+                ax += mtx(i, j) * x(j, c);
+
+            residual = std::max(residual, std::fabs(ax - b(i, c)));
+        }
+
+        for(auto c = 0u; c < n; c++)
+        {
+            double ai = 0.;
+            for(auto j = 0u; j < n; j++)
+                ai += mtx(i, j) * inverse(j, c);
+
+            inverseResidual = std::max(inverseResidual, std::fabs(ai - (i == c ? 1. : 0.)));
+        }
+    }
+
+    math::Vector column(n);
+    for(auto i = 0u; i < n; i++)
+        column[i] = b(i, 1);
+
+    const auto xColumn = factors.solve(column);
+    for(auto i = 0u; i < n; i++)
+        columnDifference = std::max(columnDifference, std::fabs(xColumn[i] - x(i, 1)));
+
+    const auto [sign, logAbs] = factors.slogdet();
+    const auto det = mtx.calculateDeterminantLU();
+
+    if(residual > 1e-10 || inverseResidual > 1e-10 || columnDifference != 0.
+       || std::fabs(sign * std::exp(logAbs) - det) > 1e-9 * std::fabs(det))
+    {
+        failures++;
+        std::cerr << "factorization: residual " << residual << ", inverse residual " << inverseResidual
+                  << ", column difference " << columnDifference << ", slogdet " << sign << " " << logAbs
+                  << " for " << det << std::endl;
+    }
+
+    // det = -10^400 overflows, its logarithm doesn't
+    math::Matrix big(400, 400);
+    for(auto i = 0u; i < 400; i++)
+        big(i, (i + 1) % 400) = i % 2 ? 10. : -10.;
+
+    const auto [bigSign, bigLog] = big.factorize().slogdet();
+    if(bigSign != -1. || std::fabs(bigLog - 400 * std::log(10.)) > 1e-9 * bigLog || !std::isinf(big.calculateDeterminantLU()))
+    {
+        failures++;
+        std::cerr << "factorization: slogdet of the big matrix gives " << bigSign << " " << bigLog << std::endl;
+    }
+
+    math::Matrix singular(3, 3);
+    singular(0, 0) = singular(1, 1) = 1.;
+    try {
+        singular.factorize().solve(math::Vector(3));
+        failures++;
+        std::cerr << "factorization: a singular matrix is solved" << std::endl;
+    }
+    catch(std::exception &)
+    {
+    }
+
+    return failures;
+}
+
+// row, column and rank one edits must track the determinant of the edited matrix,
+// through a singular matrix and back, mostly without factorizing again
+int incremental_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(44);
+
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+    std::uniform_int_distribution<size_t> index(0, 23);
+
+    math::Matrix mtx(24, 24);
+    for(auto &v : mtx._data)
+        v = distribution(generator);
+
+    math::IncrementalDeterminant incremental(mtx);
+    const size_t edits = 320;
+
+    for(auto edit = 0u; edit < edits; edit++)
+    {
+        math::Vector u(24), v(24);
+        for(auto i = 0u; i < 24; i++)
+        {
+            u[i] = distribution(generator);
+            v[i] = distribution(generator);
+        }
+
+        double det = 0.;
+        if(edit % 160 == 159)
+        {
+            const auto r = index(generator);
+            const auto copied = (r + 1) % 24;
+            det = incremental.updateRow(r, math::Vector(std::vector<double>(incremental.matrix().data() + copied * 24,
+                                                                            incremental.matrix().data() + (copied + 1) * 24)));
+        }
+        else if(edit % 3 == 0)
+            det = incremental.updateRow(index(generator), u);
+        else if(edit % 3 == 1)
+            det = incremental.updateColumn(index(generator), v);
+        else
+            det = incremental.rankOneUpdate(u, v);
+
+        const auto expected = incremental.matrix().calculateDeterminantLU();
+        if(isSameDeterminant(expected, det))
+            continue;
+
+        failures++;
+        std::cerr << "incremental determinant after " << edit + 1 << " edits gives " << std::to_string(det)
+                  << " instead of " << std::to_string(expected) << std::endl;
+        break;
+    }
+
+    if(incremental.factorizations() > edits / 32)
+    {
+        failures++;
+        std::cerr << "incremental determinant factorized " << incremental.factorizations() << " times in " << edits << " edits" << std::endl;
+    }
+
+    return failures;
+}
+
+// fixed size kernels are usable at compile time and batches reproduce them exactly
+int fixed_kernels_test()
+{
+    auto failures = 0;
+    std::mt19937 generator(43);
+
+    static_assert(math::FixedMatrix<3>{{{2., 1., 0., 0., 3., 0., 1., 0., 4.}}}.determinant() == 24.);
+
+    auto checkFixedBatch = [&](auto fixed){
+        using Fixed = decltype(fixed);
+        std::uniform_real_distribution<double> distribution(-1., 1.);
+
+        std::vector<Fixed> matrices(11);
+        for(auto &m : matrices)
+            for(auto &v : m._data)
+                v = distribution(generator);
+
+        std::vector<double> dets(matrices.size());
+        Fixed::determinants(matrices.data(), matrices.size(), dets.data());
+
+        for(auto i = 0u; i < matrices.size(); i++)
+        {
+            math::Matrix mtx(Fixed::s_Size, Fixed::s_Size);
+            std::copy(matrices[i]._data.begin(), matrices[i]._data.end(), mtx.data());
+
+            if(dets[i] == matrices[i].determinant() && isSameDeterminant(mtx.calculateDeterminantLU(), dets[i]))
+                continue;
+
+            failures++;
+            std::cerr << "batch of " << Fixed::s_Size << "x" << Fixed::s_Size << " gives " << std::to_string(dets[i])
+                      << " instead of " << std::to_string(matrices[i].determinant()) << std::endl;
+        }
+    };
+
+    checkFixedBatch(math::FixedMatrix<3>());
+    checkFixedBatch(math::FixedMatrix<4>());
+
+    // past the kernel sizes the expansion hands its small minors to them
+    for(auto n : {9u, 10u})
+    {
+        const auto mtx = randomMatrix(n, generator);
+        const auto laplace = mtx.calculateDeterminantLaplaceExpansion();
+        const auto det = mtx.calculateDeterminantLaplaceFixed();
+        if(isSameDeterminant(laplace, det))
+            continue;
+
+        failures++;
+        std::cerr << "random " << n << "x" << n << ": laplace-fixed gives " << std::to_string(det)
+                  << " instead of " << std::to_string(laplace) << std::endl;
+    }
+
+    return failures;
+}
+
+// batch over the sample matrices must list them in order with the single-file results
+int batch_test(const std::string &directory, math::TaskPool &pool)
+{
+    auto failures = 0;
+
+    std::ostringstream out;
+    math::Batch(directory + "/matrix_?.txt").run(pool, [](const math::Matrix &matrix, const math::IntegerMatrix &integers,
+                                                  const math::SparseMatrix &sparse){
+        return determinantText(matrix, integers, sparse, Options());
+    }, out);
+
+    const auto expectedOut = directory + "/matrix_1.txt: -67\n" + directory + "/matrix_2.txt: 204\n"
+                             + directory + "/matrix_3.txt: 18\n" + directory + "/matrix_4.txt: 59240787238\n";
+    if(out.str() != expectedOut)
+    {
+        failures++;
+        std::cerr << "batch over the sample matrices gives\n" << out.str() << "instead of\n" << expectedOut;
+    }
+
+    return failures;
+}
+
+int determinants_test(const std::string &directory)
+{
+    math::TaskPool pool(3);
+
+    const auto failures = algorithms_test(directory, pool) + matrix_file_test(pool) + bareiss_test() + modular_test()
+                          + blocked_lu_test() + sparse_test(pool) + laplace_parallel_test() + out_of_core_test()
+                          + cache_test() + factorization_test() + incremental_test() + fixed_kernels_test()
+                          + batch_test(directory, pool);
+
+    std::cout << (failures ? "Determinant tests failed: " + std::to_string(failures) : "Determinant tests passed") << std::endl;
+    return failures ? 1 : 0;
+}
+
+// parallel Laplace expansion timings by number of threads for n = 9..12
+int laplace_speedup(size_t maxThreads)
+{
+    std::mt19937 generator(37);
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+
+    std::cout << "n,threads,seconds,speedup" << std::endl;
+
+    for(auto n = 9u; n <= 12; n++)
+    {
+        math::Matrix mtx;
+        for(auto i = 0u; i < n; i++)
+        {
+            std::vector<double> values(n);
+            for(auto &v : values)
+                v = distribution(generator);
+
+            mtx.addRow(math::Vector(std::move(values)));
+        }
+
+        double sequential = 0.;
+        for(size_t threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            mtx.calculateDeterminantLaplaceParallel(threads);
+            const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+            if(threads == 1)
+                sequential = seconds.count();
+
+            std::cout << n << "," << threads << "," << seconds.count() << "," << sequential / seconds.count() << std::endl;
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     std::string toCin;
@@ -37,33 +1264,110 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    std::ifstream inputFile(argv[1]);
+    if(std::string(argv[1]) == "test")
+        return determinants_test(argc > 2 ? argv[2] : ".");
+
+    if(std::string(argv[1]) == "speedup")
+        return laplace_speedup(argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency()));
 
-    if (!inputFile.is_open()) {
-        std::cerr << "Failed to open the file." << std::endl;
+    const auto isBatch = std::string(argv[1]) == "batch";
+    if(isBatch && argc < 3)
+    {
+        std::cerr << "Batch needs a directory, a file pattern or a multi-matrix file" << std::endl;
         return 1;
     }
 
-    auto matrix = readMatrix(inputFile);
-
-    if(matrix.isEmpty())
+    Options options;
+    try {
+        options = parseOptions(argc, argv, isBatch ? 3 : 2);
+    }
+    catch(std::exception &ex)
     {
-        std::cerr << "Matrix should not be empty" << std::endl;
+        std::cerr << ex.what() << std::endl;
         return 1;
     }
 
-    if(!matrix.isSquare())
+    if(isBatch)
     {
-        std::cerr << "Matrix should be square" << std::endl;
+        int res = 0;
+        {
+            MATH_PROFILE_PHASE("batch");
+            res = determinants_batch(argv[2], options);
+        }
+
+        writeProfile(options);
+        return res;
+    }
+
+    if(options._memoryBudget)
+        return determinant_out_of_core(argv[1], options);
+
+    math::IntegerMatrix integers;
+    math::SparseMatrix sparse;
+    math::Matrix matrix;
+
+    try {
+        math::TaskPool pool(options._threads ? options._threads : std::thread::hardware_concurrency());
+
+        const auto start = std::chrono::steady_clock::now();
+        {
+            MATH_PROFILE_PHASE("read");
+            matrix = math::readMatrixFile(argv[1], pool, &integers, &sparse);
+        }
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        if(options._readStats)
+        {
+            const auto megabytes = std::filesystem::file_size(argv[1]) / 1e6;
+            std::cout << "Read " << megabytes << " MB in " << seconds.count() << " s: "
+                      << megabytes / seconds.count() << " MB/s" << std::endl;
+        }
+
+        if(!options._writeBinary.empty())
+            math::writeMatrixBinary(sparse.isEmpty() ? matrix : math::Matrix::fromSparse(sparse), options._writeBinary);
+    }
+    catch(std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
         return 1;
     }
 
+    {
+        MATH_PROFILE_PHASE("validate");
+
+        if(matrix.isEmpty() && sparse.isEmpty())
+        {
+            std::cerr << "Matrix should not be empty" << std::endl;
+            return 1;
+        }
+
+        if(!matrix.isSquare() || !sparse.isSquare())
+        {
+            std::cerr << "Matrix should be square" << std::endl;
+            return 1;
+        }
+    }
+
     try {
-        const auto determinant = matrix.calculateDeterminantLaplaceExpansion();
+        std::unique_ptr<math::DeterminantCache> cache;
+        if(!options._cache.empty())
+            cache = std::make_unique<math::DeterminantCache>(options._cache, options._cacheSize);
+
+        std::string determinant;
+        {
+            MATH_PROFILE_PHASE("compute");
+            determinant = cachedDeterminantText(cache.get(), matrix, integers, sparse, options);
+        }
+
+        MATH_PROFILE_PHASE("print");
 
         std::cout << "Determinant for matrix: " << std::endl;
-        std::cout << matrix;
-        std::cout << "Is: " << std::to_string(determinant) <<  std::endl;
+        if(sparse.isEmpty())
+            std::cout << matrix;
+        else
+            std::cout << "sparse " << sparse.rows() << "x" << sparse.cols() << " with " << sparse.nonZeros() << " nonzeros" << std::endl;
+        std::cout << "Is: " << determinant <<  std::endl;
+        writeCacheStatistics(cache.get());
     }
     catch(std::exception &ex)
     {
@@ -71,5 +1375,6 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    writeProfile(options);
     return 0;
 }